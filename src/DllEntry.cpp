@@ -99,6 +99,7 @@ __declspec(dllexport) int LibInitialize(void) {
   printer.AddPrinterFunction(PrintLog);
   Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
   BuildHavokResources();
+  BuildExtensionTable();
   return TRUE;
 }
 
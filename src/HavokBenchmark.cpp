@@ -0,0 +1,387 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#include "HavokCore.h"
+#include "MemoryScene.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+// Benchmark of conversion hot paths over synthetic rigs in memory scene.
+// Allocations are counted by replaced global operator new/delete.
+
+namespace {
+std::atomic<size_t> numAllocs(0);
+std::atomic<size_t> allocatedBytes(0);
+std::atomic<size_t> liveBytes(0);
+std::atomic<size_t> peakBytes(0);
+
+// Keeps alignment of default operator new
+const size_t allocHeader = alignof(std::max_align_t);
+} // namespace
+
+void *operator new(size_t size) {
+  void *block = std::malloc(size + allocHeader);
+
+  if (!block) {
+    throw std::bad_alloc();
+  }
+
+  *static_cast<size_t *>(block) = size;
+  numAllocs++;
+  allocatedBytes += size;
+  const size_t live = liveBytes += size;
+  size_t peak = peakBytes;
+
+  while (live > peak && !peakBytes.compare_exchange_weak(peak, live)) {
+  }
+
+  return static_cast<char *>(block) + allocHeader;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void *ptr) noexcept {
+  if (!ptr) {
+    return;
+  }
+
+  void *block = static_cast<char *>(ptr) - allocHeader;
+  liveBytes -= *static_cast<size_t *>(block);
+  std::free(block);
+}
+
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+void operator delete(void *ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { operator delete(ptr); }
+
+static const char helpText[] =
+    "Usage: HavokBenchmark [options] [packfile]...\n"
+    "Runs export paths over synthetic rigs in memory scene and import paths\n"
+    "over given packfiles (interleaved, spline or delta compressed).\n"
+    "Options:\n"
+    "  -b <list>      Bone counts, default 10,100,2000\n"
+    "  -f <list>      Frame counts, default 10,1000,100000\n"
+    "  -m, --max-samples <count>\n"
+    "                 Skip rigs with more bones * frames, 0 = no limit,\n"
+    "                 default 10000000 (about 2 GB of peak heap)\n"
+    "  --all          Run all rigs, same as --max-samples 0\n"
+    "  -r <count>     Repetitions, best time is reported, default 3\n"
+    "  -j <count>     Number of worker threads, 0 = all (default 1)\n";
+
+struct BenchmarkSettings {
+  std::vector<size_t> boneCounts{10, 100, 2000};
+  std::vector<size_t> frameCounts{10, 1000, 100000};
+  // 2000 bones x 100k frames needs about 35 GB, so it's opt-in
+  size_t maxSamples = 10000000;
+  size_t numRepeats = 3;
+  size_t numThreads = 1;
+  std::vector<std::string> packfiles;
+};
+
+struct BenchmarkResult {
+  double seconds = 0.0;
+  size_t numAllocs = 0;
+  size_t allocatedBytes = 0;
+  size_t peakBytes = 0;
+};
+
+// Runs func numRepeats times, reports best time and heap usage of last run.
+// Peak is measured above heap in use before the run.
+template <class F> BenchmarkResult Measure(size_t numRepeats, F &&func) {
+  typedef std::chrono::steady_clock Clock;
+  BenchmarkResult result;
+  result.seconds = HUGE_VAL;
+
+  for (size_t r = 0; r < numRepeats; r++) {
+    const size_t baseAllocs = numAllocs;
+    const size_t baseBytes = allocatedBytes;
+    const size_t baseLive = liveBytes;
+    peakBytes = baseLive;
+    const auto start = Clock::now();
+
+    func();
+
+    const double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    result.seconds = std::min(result.seconds, seconds);
+    result.numAllocs = numAllocs - baseAllocs;
+    result.allocatedBytes = allocatedBytes - baseBytes;
+    result.peakBytes = peakBytes - baseLive;
+  }
+
+  return result;
+}
+
+static void PrintHeader() {
+  printf("%-18s %6s %7s %11s %12s %10s %10s %10s\n", "case", "bones",
+         "frames", "time [ms]", "ns/bone/frm", "allocs", "alloc [MB]",
+         "peak [MB]");
+}
+
+static void PrintResult(const std::string &name, size_t numBones,
+                        size_t numFrames, const BenchmarkResult &result) {
+  const double numSamples =
+      static_cast<double>(std::max<size_t>(numBones * numFrames, 1));
+  printf("%-18s %6zu %7zu %11.3f %12.2f %10zu %10.2f %10.2f\n", name.c_str(),
+         numBones, numFrames, result.seconds * 1e3,
+         result.seconds * 1e9 / numSamples, result.numAllocs,
+         result.allocatedBytes / 1048576.0, result.peakBytes / 1048576.0);
+  fflush(stdout);
+}
+
+// Limb chains of 5 bones attached along the rig.
+// Every 4th bone is static, rest is animated.
+static void BuildRig(MemoryScene &scene, size_t numBones, size_t numFrames) {
+  std::vector<MemorySceneNode *> bones;
+  std::vector<float> times(numFrames);
+  std::vector<AffineTM> values(numFrames);
+
+  for (size_t f = 0; f < numFrames; f++) {
+    times[f] = f / scene.frameRate;
+  }
+
+  for (size_t b = 0; b < numBones; b++) {
+    MemorySceneNode *parent = nullptr;
+
+    if (b) {
+      parent = bones[b % 5 ? b - 1 : b / 5];
+    }
+
+    bones.push_back(scene.AddNode("bone" + std::to_string(b), parent));
+    MemorySceneNode *bone = bones.back();
+    bone->localTM.SetTrans(Vector4A16(b ? 10.0f : 0.0f, 0.0f, 0.0f, 0.0f));
+
+    if (!(b % 4)) {
+      continue;
+    }
+
+    for (size_t f = 0; f < numFrames; f++) {
+      const float angle = 0.5f * std::sin(times[f] * 2.0f + b);
+      AffineTM &v = values[f];
+      v = bone->localTM;
+      v.SetRotate(Vector4A16(std::sin(angle), 0.0f, 0.0f, std::cos(angle)));
+    }
+
+    bone->SetLocalKeys(times, values);
+  }
+
+  scene.SetAnimRange(0.0f, times.back());
+}
+
+static void RunExport(const BenchmarkSettings &settings, size_t numBones,
+                      size_t numFrames) {
+  MemoryScene scene;
+  BuildRig(scene, numBones, numFrames);
+
+  auto result = Measure(settings.numRepeats, [&] {
+    HavokExportCore core(scene);
+    core.numThreads = settings.numThreads;
+    xmlSkeleton skel;
+    core.BuildSkeleton(&skel);
+  });
+  PrintResult("skeleton", numBones, 1, result);
+
+  const char *reductionNames[] = {"export sample", "export optimize",
+                                  "export compress"};
+
+  for (int r = 0; r < 3; r++) {
+    HavokExportCore core(scene);
+    core.numThreads = settings.numThreads;
+    core.animationEnd = static_cast<int32>(numFrames - 1);
+    core.optimizeTracks = r == 1;
+    core.compressTracks = r == 2;
+    xmlSkeleton skel;
+    core.BuildSkeleton(&skel);
+
+    result = Measure(settings.numRepeats, [&] {
+      xmlAnimationBinding binding;
+      xmlInterleavedAnimation anim;
+      core.ProcessAnimation(&skel, &binding, &anim);
+    });
+    PrintResult(reductionNames[r], numBones, numFrames, result);
+  }
+
+  std::vector<hkQTransform> samples(numBones * numFrames);
+
+  for (size_t s = 0; s < samples.size(); s++) {
+    const float angle = std::sin(s * 0.01f);
+    const float sign = s & 1 ? -1.0f : 1.0f;
+    samples[s].rotation = Vector4A16(sign * std::sin(angle), 0.0f, 0.0f,
+                                     sign * std::cos(angle));
+  }
+
+  result = Measure(settings.numRepeats, [&] {
+    for (size_t b = 0; b < numBones; b++) {
+      MakeQuatsContinuous(&samples[b * numFrames].rotation, numFrames, 3);
+    }
+  });
+  PrintResult("quat continuity", numBones, numFrames, result);
+}
+
+static void RunImport(const BenchmarkSettings &settings,
+                      const hkaAnimationContainer *aniCont) {
+  size_t numBones = 0;
+
+  for (auto s : aniCont->Skeletons()) {
+    numBones += s->GetNumBones();
+  }
+
+  auto result = Measure(settings.numRepeats, [&] {
+    MemoryScene scene;
+    HavokImportCore core(scene);
+    core.numThreads = settings.numThreads;
+
+    for (auto s : aniCont->Skeletons()) {
+      core.LoadSkeleton(s);
+    }
+  });
+  PrintResult("import skeleton", numBones, 1, result);
+
+  const float frameRate = MemoryScene().frameRate;
+
+  // Every animation is imported on its own, decode, additive blending and
+  // root motion are part of LoadAnimation.
+  for (size_t a = 0; a < aniCont->GetNumAnimations(); a++) {
+    const hkaAnimation *ani = aniCont->GetAnimation(a);
+    const hkaAnimationBinding *bind =
+        aniCont->GetNumBindings() ? aniCont->GetBinding(a) : nullptr;
+    const size_t numTracks = ani->GetNumOfTransformTracks();
+    const size_t numFrames =
+        static_cast<size_t>(std::round(ani->Duration() * frameRate)) + 1;
+    MemoryScene scene;
+    HavokImportCore core(scene);
+    core.numThreads = settings.numThreads;
+
+    for (auto s : aniCont->Skeletons()) {
+      core.LoadSkeleton(s);
+    }
+
+    result =
+        Measure(settings.numRepeats, [&] { core.LoadAnimation(ani, bind); });
+    PrintResult("import " + ani->GetAnimationTypeName().to_string(),
+                numTracks, numFrames, result);
+  }
+}
+
+static void RunPackfile(const BenchmarkSettings &settings,
+                        const std::string &path) {
+  std::unique_ptr<IhkPackFile> pFile;
+  auto result = Measure(settings.numRepeats, [&] {
+    pFile.reset();
+    pFile = std::unique_ptr<IhkPackFile>(IhkPackFile::Create(path));
+  });
+  const size_t slash = path.find_last_of("/\\");
+  printf("%s\n", path.substr(slash == path.npos ? 0 : slash + 1).c_str());
+  PrintResult("file parse", 1, 1, result);
+
+  for (auto &v : *pFile->GetRootLevelContainer()) {
+    if (v == hkaAnimationContainer::GetHash()) {
+      RunImport(settings, v);
+    }
+  }
+}
+
+static bool ParseList(const char *text, std::vector<size_t> &values) {
+  values.clear();
+  std::istringstream str(text);
+  std::string item;
+
+  while (std::getline(str, item, ',')) {
+    const size_t value = std::strtoul(item.c_str(), nullptr, 10);
+
+    if (!value) {
+      return false;
+    }
+
+    values.push_back(value);
+  }
+
+  return !values.empty();
+}
+
+static bool ParseArgs(int argc, char *argv[], BenchmarkSettings &settings) {
+  for (int a = 1; a < argc; a++) {
+    const std::string arg = argv[a];
+    const bool hasValue = a + 1 < argc;
+
+    if (arg == "-b" && hasValue) {
+      if (!ParseList(argv[++a], settings.boneCounts)) {
+        return false;
+      }
+    } else if (arg == "-f" && hasValue) {
+      if (!ParseList(argv[++a], settings.frameCounts)) {
+        return false;
+      }
+    } else if ((arg == "-m" || arg == "--max-samples") && hasValue) {
+      settings.maxSamples = std::strtoul(argv[++a], nullptr, 10);
+    } else if (arg == "--all") {
+      settings.maxSamples = 0;
+    } else if (arg == "-r" && hasValue) {
+      settings.numRepeats =
+          std::max<size_t>(std::strtoul(argv[++a], nullptr, 10), 1);
+    } else if (arg == "-j" && hasValue) {
+      settings.numThreads = std::strtoul(argv[++a], nullptr, 10);
+    } else if (!arg.empty() && arg[0] == '-') {
+      return false;
+    } else {
+      settings.packfiles.push_back(arg);
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  BenchmarkSettings settings;
+
+  if (!ParseArgs(argc, argv, settings)) {
+    std::cout << helpText;
+    return 1;
+  }
+
+  PrintHeader();
+
+  for (size_t numBones : settings.boneCounts) {
+    for (size_t numFrames : settings.frameCounts) {
+      if (settings.maxSamples && numBones * numFrames > settings.maxSamples) {
+        printf("skipping %zu bones x %zu frames\n", numBones, numFrames);
+        continue;
+      }
+
+      RunExport(settings, numBones, numFrames);
+    }
+  }
+
+  for (auto &p : settings.packfiles) {
+    try {
+      RunPackfile(settings, p);
+    } catch (const std::exception &e) {
+      printf("%s: %s\n", p.c_str(), e.what());
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,531 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#include "HavokCore.h"
+#include "HavokParallel.h"
+#include "MemoryScene.h"
+#include "datas/directory_scanner.hpp"
+#include "datas/master_printer.hpp"
+#include "datas/pugiex.hpp"
+#include "datas/reflector.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define MakeFolder(path) _mkdir(path)
+#else
+#define MakeFolder(path) mkdir(path, 0755)
+#endif
+
+// Headless batch converter. Every input packfile is imported into memory
+// scene and exported again through the same conversion engine as plugin.
+
+static const char helpText[] =
+    "Usage: HavokConvert [options] -o <folder> <file or folder>...\n"
+    "Converts hkx/hkt/hka packfiles into xml packfiles or json dumps.\n"
+    "Folders are scanned recursively, folder structure is kept in output.\n"
+    "Options:\n"
+    "  -o <folder>    Output folder (required)\n"
+    "  -t <toolset>   Output toolset, for example HK2010_2 (default HK500)\n"
+    "  -i <preset>    Preset xml applied on import (scale, matrix)\n"
+    "  -e <preset>    Preset xml applied on export (scale, matrix)\n"
+    "  -j <count>     Number of worker threads, 0 = all (default 0)\n"
+    "  --fps <rate>   Sampling rate of animations, use source rate to avoid\n"
+    "                 resampling (default 30)\n"
+    "  --json         Write json animation dump instead of packfile\n"
+    "  --optimize     Remove tracks, that keep reference pose\n"
+    "  --compress     Reduce and resample tracks within default tolerance\n"
+    "  --verbose      Print conversion log of every file\n"
+    "Conversion goes through the plugin's scene model and loses:\n"
+    "  - every class except skeletons and animations (physics, ragdolls,\n"
+    "    mappers, attachments, user data)\n"
+    "  - separate skeletons, all bones are merged into \"Reference\"\n"
+    "  - extracted motion, it's baked into root bones\n"
+    "  - source key spacing, animations are resampled at --fps with linear\n"
+    "    interpolation and durations are rounded to whole frames\n";
+
+struct ConvertPreset {
+  float scale = 1.0f;
+  AffineTM corMat;
+};
+
+struct ConvertSettings {
+  std::string outputFolder;
+  hkToolset toolset = HK500;
+  ConvertPreset importPreset;
+  ConvertPreset exportPreset;
+  size_t numThreads = 0;
+  float frameRate = 30.0f;
+  bool jsonDump = false;
+  bool optimizeTracks = false;
+  bool compressTracks = false;
+  bool verbose = false;
+};
+
+struct ConvertJob {
+  std::string inputPath;
+  // Output path without extension, relative to output folder
+  std::string outputName;
+};
+
+struct ConvertResult {
+  double seconds = 0.0;
+  bool success = false;
+  std::string error;
+};
+
+static std::mutex outputMutex;
+
+static void PrintLine(const std::string &line) {
+  std::lock_guard<std::mutex> lock(outputMutex);
+  std::cout << line << std::endl;
+}
+
+static void PrintLog(const char *msg) {
+  std::lock_guard<std::mutex> lock(outputMutex);
+  std::cout << msg;
+}
+
+// Same format as external presets of plugin
+static bool LoadPreset(const std::string &path, ConvertPreset &preset) {
+  try {
+    pugi::xml_document doc = XMLFromFile(path);
+    pugi::xml_node prNode = doc.child("HavokPreset");
+
+    if (prNode.empty()) {
+      return false;
+    }
+
+    pugi::xml_node scaleNode = prNode.child("scale");
+    preset.scale = scaleNode.empty()
+                       ? prNode.attribute("scale").as_float(1.0f)
+                       : scaleNode.text().as_float(1.0f);
+
+    pugi::xml_node corMatNode = prNode.child("matrix");
+
+    if (!corMatNode.empty()) {
+      ParseCorrectionMatrix(preset.corMat, corMatNode.text().get());
+    }
+  } catch (...) {
+    return false;
+  }
+
+  return true;
+}
+
+static bool ParseToolset(const std::string &name, hkToolset &toolset) {
+  auto ren = GetReflectedEnum<hkToolset>();
+  int value = 0;
+
+  for (auto t : ren) {
+    if (t.to_string() == name) {
+      toolset = static_cast<hkToolset>(value);
+      return value != HKUNKVER;
+    }
+
+    value++;
+  }
+
+  return false;
+}
+
+static bool IsPackfile(const std::string &path) {
+  const size_t dotPos = path.find_last_of('.');
+
+  if (dotPos == path.npos) {
+    return false;
+  }
+
+  std::string extension = path.substr(dotPos + 1);
+
+  for (auto &c : extension) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+
+  return extension == "hkx" || extension == "hkt" || extension == "hka";
+}
+
+static std::string StripExtension(const std::string &path) {
+  const size_t folderEnd = path.find_last_of("/\\");
+  const size_t dotPos = path.find_last_of('.');
+
+  if (dotPos == path.npos || (folderEnd != path.npos && dotPos < folderEnd)) {
+    return path;
+  }
+
+  return path.substr(0, dotPos);
+}
+
+static void CollectJobs(const std::string &input,
+                        std::vector<ConvertJob> &jobs) {
+  struct stat inputStat;
+
+  if (stat(input.c_str(), &inputStat)) {
+    PrintLine("Cannot find input: " + input);
+    return;
+  }
+
+  if (!(inputStat.st_mode & S_IFDIR)) {
+    const size_t folderEnd = input.find_last_of("/\\");
+    const std::string fileName =
+        folderEnd == input.npos ? input : input.substr(folderEnd + 1);
+    jobs.push_back({input, StripExtension(fileName)});
+    return;
+  }
+
+  std::string folder = input;
+
+  while (folder.size() > 1 &&
+         (folder.back() == '/' || folder.back() == '\\')) {
+    folder.pop_back();
+  }
+
+  DirectoryScanner scanner;
+  scanner.AddFilter(".hkx");
+  scanner.AddFilter(".hkt");
+  scanner.AddFilter(".hka");
+  scanner.Scan(folder);
+
+  for (auto &s : scanner) {
+    if (!IsPackfile(s)) {
+      continue;
+    }
+
+    std::string relative = s.substr(std::min(folder.size() + 1, s.size()));
+    jobs.push_back({s, StripExtension(relative)});
+  }
+}
+
+static void MakeFolders(const std::string &filePath) {
+  for (size_t pos = filePath.find_first_of("/\\", 1); pos != filePath.npos;
+       pos = filePath.find_first_of("/\\", pos + 1)) {
+    MakeFolder(filePath.substr(0, pos).c_str());
+  }
+}
+
+static void WriteJSONVector(std::ostream &str, const Vector4A16 &value,
+                            int numComponents) {
+  const float components[] = {value.X, value.Y, value.Z, value.W};
+  str << '[';
+
+  for (int c = 0; c < numComponents; c++) {
+    str << (c ? "," : "") << components[c];
+  }
+
+  str << ']';
+}
+
+static void WriteJSON(const std::string &path, const xmlSkeleton *skel,
+                      const std::vector<HavokExportClip> &clips,
+                      const std::vector<xmlAnimationBinding *> &binds,
+                      const std::vector<xmlInterleavedAnimation *> &anims) {
+  std::ofstream str(path);
+
+  if (str.fail()) {
+    throw std::runtime_error("Cannot create file: " + path);
+  }
+
+  str << "{\n  \"skeleton\": [";
+
+  for (size_t b = 0; b < skel->bones.size(); b++) {
+    const xmlBone *cBone = skel->bones[b].get();
+    str << (b ? ",\n" : "\n") << "    {\"name\": \""
+        << EscapeJSON(cBone->name) << "\", \"parent\": "
+        << (cBone->parent ? cBone->parent->ID : -1) << ", \"translation\": ";
+    WriteJSONVector(str, cBone->transform.translation, 3);
+    str << ", \"rotation\": ";
+    WriteJSONVector(str, cBone->transform.rotation, 4);
+    str << '}';
+  }
+
+  str << "\n  ],\n  \"animations\": [";
+
+  for (size_t c = 0; c < clips.size(); c++) {
+    const xmlInterleavedAnimation *anim = anims[c];
+    str << (c ? ",\n" : "\n") << "    {\"name\": \""
+        << EscapeJSON(clips[c].name) << "\", \"duration\": " << anim->duration
+        << ", \"tracks\": [";
+
+    for (size_t t = 0; t < anim->transforms.size(); t++) {
+      str << (t ? ",\n" : "\n") << "      {\"bone\": "
+          << binds[c]->transformTrackToBoneIndices[t]
+          << ", \"translation\": [";
+      const auto &frames = *anim->transforms[t];
+
+      for (size_t f = 0; f < frames.size(); f++) {
+        str << (f ? "," : "");
+        WriteJSONVector(str, frames[f].translation, 3);
+      }
+
+      str << "], \"rotation\": [";
+
+      for (size_t f = 0; f < frames.size(); f++) {
+        str << (f ? "," : "");
+        WriteJSONVector(str, frames[f].rotation, 4);
+      }
+
+      str << "], \"scale\": [";
+
+      for (size_t f = 0; f < frames.size(); f++) {
+        str << (f ? "," : "");
+        WriteJSONVector(str, frames[f].scale, 3);
+      }
+
+      str << "]}";
+    }
+
+    str << "\n    ]}";
+  }
+
+  str << "\n  ]\n}\n";
+}
+
+static void ConvertFile(const ConvertJob &job,
+                        const ConvertSettings &settings) {
+  std::unique_ptr<IhkPackFile> pFile;
+
+  {
+    std::lock_guard<std::mutex> lock(HavokLibMutex());
+    pFile = std::unique_ptr<IhkPackFile>(IhkPackFile::Create(job.inputPath));
+  }
+
+  if (!pFile) {
+    throw std::runtime_error("Unrecognized packfile.");
+  }
+
+  MemoryScene scene;
+  scene.frameRate = settings.frameRate;
+  HavokImportCore importer(scene);
+  importer.objectScale = settings.importPreset.scale;
+  importer.corMat = settings.importPreset.corMat;
+  // Files are converted in parallel already
+  importer.numThreads = 1;
+
+  for (auto &v : *pFile->GetRootLevelContainer()) {
+    if (v == hkaAnimationContainer::GetHash()) {
+      const hkaAnimationContainer *aniCont = v;
+
+      for (auto s : aniCont->Skeletons()) {
+        importer.LoadSkeleton(s);
+      }
+
+      const size_t numAnimations = aniCont->GetNumAnimations();
+
+      if (numAnimations) {
+        std::vector<size_t> indices;
+        ParseMotionList("", numAnimations, indices);
+        importer.LoadAnimations(aniCont, indices);
+      }
+    }
+  }
+
+  HavokExportCore exporter(scene);
+  exporter.SetupCorrection(settings.exportPreset.scale,
+                           settings.exportPreset.corMat);
+  exporter.optimizeTracks = settings.optimizeTracks;
+  exporter.compressTracks = settings.compressTracks;
+  exporter.numThreads = 1;
+
+  xmlHavokFile hkFile = {};
+  xmlRootLevelContainer *cont = hkFile.NewClass<xmlRootLevelContainer>();
+  xmlAnimationContainer *aniCont = hkFile.NewClass<xmlAnimationContainer>();
+  xmlSkeleton *skel = hkFile.NewClass<xmlSkeleton>();
+  skel->name = "Reference";
+  exporter.BuildSkeleton(skel);
+  cont->AddVariant(aniCont);
+  aniCont->skeletons.push_back(skel);
+
+  // Every imported motion is marked as clip in scene
+  std::vector<HavokExportClip> clips;
+  exporter.GetSceneClips(clips);
+  std::vector<xmlAnimationBinding *> binds;
+  std::vector<xmlInterleavedAnimation *> anims;
+
+  for (size_t c = 0; c < clips.size(); c++) {
+    xmlAnimationBinding *binding = hkFile.NewClass<xmlAnimationBinding>();
+    xmlInterleavedAnimation *anim = hkFile.NewClass<xmlInterleavedAnimation>();
+    binding->animation = anim;
+    binding->skeletonName = skel->name;
+    aniCont->animations.push_back(anim);
+    aniCont->bindings.push_back(binding);
+    binds.push_back(binding);
+    anims.push_back(anim);
+  }
+
+  if (!clips.empty()) {
+    exporter.ProcessAnimations(skel, clips, binds, anims);
+  }
+
+  const std::string outPath = settings.outputFolder + "/" + job.outputName +
+                              (settings.jsonDump ? ".json" : ".xml");
+  MakeFolders(outPath);
+
+  if (settings.jsonDump) {
+    WriteJSON(outPath, skel, clips, binds, anims);
+  } else {
+    std::lock_guard<std::mutex> lock(HavokLibMutex());
+    hkFile.ToXML(std::to_string(outPath), settings.toolset);
+  }
+}
+
+static bool ParseArgs(int argc, char *argv[], ConvertSettings &settings,
+                      std::vector<std::string> &inputs) {
+  for (int a = 1; a < argc; a++) {
+    const std::string arg = argv[a];
+    const bool hasValue = a + 1 < argc;
+
+    if (arg == "-o" && hasValue) {
+      settings.outputFolder = argv[++a];
+    } else if (arg == "-t" && hasValue) {
+      if (!ParseToolset(argv[++a], settings.toolset)) {
+        PrintLine(std::string("Unknown toolset: ") + argv[a]);
+        return false;
+      }
+    } else if ((arg == "-i" || arg == "-e") && hasValue) {
+      ConvertPreset &preset =
+          arg == "-i" ? settings.importPreset : settings.exportPreset;
+
+      if (!LoadPreset(argv[++a], preset)) {
+        PrintLine(std::string("Cannot load preset: ") + argv[a]);
+        return false;
+      }
+    } else if (arg == "-j" && hasValue) {
+      settings.numThreads = std::strtoul(argv[++a], nullptr, 10);
+    } else if (arg == "--fps" && hasValue) {
+      settings.frameRate = static_cast<float>(std::atof(argv[++a]));
+
+      if (!(settings.frameRate > 0.0f)) {
+        PrintLine(std::string("Invalid frame rate: ") + argv[a]);
+        return false;
+      }
+    } else if (arg == "--json") {
+      settings.jsonDump = true;
+    } else if (arg == "--optimize") {
+      settings.optimizeTracks = true;
+    } else if (arg == "--compress") {
+      settings.compressTracks = true;
+    } else if (arg == "--verbose") {
+      settings.verbose = true;
+    } else if (!arg.empty() && arg[0] == '-') {
+      PrintLine("Unknown option: " + arg);
+      return false;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+
+  return !settings.outputFolder.empty() && !inputs.empty();
+}
+
+int main(int argc, char *argv[]) {
+  RegisterReflectedTypes<hkToolset>();
+  ConvertSettings settings;
+  std::vector<std::string> inputs;
+
+  if (!ParseArgs(argc, argv, settings, inputs)) {
+    std::cout << helpText;
+    return 1;
+  }
+
+  if (settings.verbose) {
+    printer.AddPrinterFunction(PrintLog);
+  }
+
+  std::vector<ConvertJob> jobs;
+
+  for (auto &i : inputs) {
+    CollectJobs(i, jobs);
+  }
+
+  typedef std::chrono::steady_clock Clock;
+  std::vector<ConvertResult> results(jobs.size());
+  const auto startTime = Clock::now();
+
+  ParallelFor(jobs.size(), settings.numThreads, [&](size_t j) {
+    ConvertResult &result = results[j];
+    const auto fileStart = Clock::now();
+
+    try {
+      ConvertFile(jobs[j], settings);
+      result.success = true;
+    } catch (const std::exception &e) {
+      result.error = e.what();
+    } catch (...) {
+      result.error = "Unhandled exception has been thrown!";
+    }
+
+    result.seconds =
+        std::chrono::duration<double>(Clock::now() - fileStart).count();
+
+    std::ostringstream str;
+    str << (result.success ? "OK   " : "FAIL ") << result.seconds << " s "
+        << jobs[j].inputPath;
+
+    if (!result.success) {
+      str << ": " << result.error;
+    }
+
+    PrintLine(str.str());
+  });
+
+  const double totalSeconds =
+      std::chrono::duration<double>(Clock::now() - startTime).count();
+  std::vector<size_t> order(jobs.size());
+  size_t numFailed = 0;
+  double summedSeconds = 0.0;
+
+  for (size_t j = 0; j < jobs.size(); j++) {
+    order[j] = j;
+    numFailed += !results[j].success;
+    summedSeconds += results[j].seconds;
+  }
+
+  std::sort(order.begin(), order.end(), [&](size_t j0, size_t j1) {
+    return results[j0].seconds > results[j1].seconds;
+  });
+
+  std::ostringstream str;
+  str << "\nConverted " << jobs.size() - numFailed << " of " << jobs.size()
+      << " files in " << totalSeconds << " s using "
+      << GetNumWorkers(settings.numThreads, jobs.size()) << " workers";
+
+  if (!jobs.empty()) {
+    str << ", average " << summedSeconds / jobs.size() << " s per file";
+  }
+
+  str << "\nSlowest files:";
+
+  for (size_t j = 0; j < std::min<size_t>(order.size(), 10); j++) {
+    str << "\n  " << results[order[j]].seconds << " s "
+        << jobs[order[j]].inputPath;
+  }
+
+  PrintLine(str.str());
+
+  return numFailed ? 2 : 0;
+}
@@ -0,0 +1,229 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#pragma once
+#include "HavokScene.h"
+#include "HavokStats.h"
+#include "HavokTracks.h"
+#include "havok_api.hpp"
+#include "havok_xml.hpp"
+#include <unordered_map>
+
+// Scene independent conversion engine shared by plugin and standalone tools.
+
+class HavokBoneScanner {
+  typedef std::unordered_map<int, HavokSceneNode *> BoneIndex;
+
+public:
+  std::vector<HavokSceneNode *> bones;
+  size_t numLookups = 0;
+  size_t numMisses = 0;
+
+  void RescanBones(const std::vector<HavokSceneNode *> &nodes);
+  HavokSceneNode *LookupNode(int ID);
+  // Searches bones of given skeleton first, then falls back to any skeleton
+  HavokSceneNode *LookupNode(const std::string &skeletonName, int ID);
+
+private:
+  BoneIndex boneIndex;
+  std::unordered_map<std::string, BoneIndex> skeletonIndex;
+};
+
+// Name to node map built from a single scene enumeration.
+// Exact names are preferred, case insensitive match is used as fallback.
+class HavokNameIndex {
+public:
+  size_t numLookups = 0;
+  size_t numMisses = 0;
+
+  void Rebuild(const std::vector<HavokSceneNode *> &nodes);
+  void AddNode(HavokSceneNode *node);
+  // Renames node, entries of previous name are dropped
+  void RenameNode(HavokSceneNode *node, const std::string &name);
+  HavokSceneNode *LookupNode(const std::string &name);
+
+private:
+  std::unordered_map<std::string, HavokSceneNode *> names;
+  std::unordered_map<std::string, HavokSceneNode *> foldedNames;
+};
+
+// Single animation being imported, times are relative to clip start
+struct HavokImportClip {
+  const hkaAnimation *ani = nullptr;
+  const hkaAnimationBinding *bind = nullptr;
+  std::string name;
+  // Clip start on scene timeline, keys are placed at whole frames from it,
+  // so they match frames sampled by export exactly.
+  size_t startFrame = 0;
+  float offset = 0.0f;
+  std::vector<float> times;
+  std::vector<HavokSceneNode *> trackNodes;
+  // Decoded tracks, [frame][track]
+  std::vector<hkQTransform> samples;
+  // Final local transforms, [frame][trackNode]
+  std::vector<AffineTM> locals;
+};
+
+// Parses comma separated motion indices and ranges ("0, 2, 5-8").
+// Empty list selects all animations.
+void ParseMotionList(const std::string &list, size_t numAnimations,
+                     std::vector<size_t> &indices);
+
+class HavokImportCore {
+public:
+  HavokScene &scene;
+  float objectScale = 1.0f;
+  AffineTM corMat;
+  bool disableScale = false;
+  int32 additiveOverride = 0;
+  // 0 = use all hardware threads
+  size_t numThreads = 0;
+  // Optional, receives stage timings and counters
+  HavokStats *stats = nullptr;
+
+  HavokImportCore(HavokScene &scene_) : scene(scene_) {}
+
+  // Samples transform tracks of all clips on worker threads,
+  // tracks without node are skipped.
+  void DecodeClips(std::vector<HavokImportClip> &clips);
+
+  void LoadSkeleton(const hkaSkeleton *skel);
+  void LoadAnimation(const hkaAnimation *ani, const hkaAnimationBinding *bind);
+  // Imports selected animations one after another on the timeline,
+  // clip ranges are marked in scene.
+  void LoadAnimations(const hkaAnimationContainer *aniCont,
+                      const std::vector<size_t> &indices);
+
+private:
+  HavokBoneScanner boneScanner;
+  HavokNameIndex nameIndex;
+  bool sceneScanned = false;
+
+  void ScanScene();
+  void PrepareClip(HavokImportClip &clip);
+  // Converts decoded samples into scene locals, including additive blending,
+  // scale compensation and extracted root motion.
+  void BuildLocals(HavokImportClip &clip);
+  // Divides translations of non root tracks by world scale of their parents.
+  // World transforms are chained from decoded locals in parent order,
+  // instead of querying scene for every key.
+  void CompensateParentScale(const std::vector<HavokSceneNode *> &trackNodes,
+                             size_t numFrames, std::vector<AffineTM> &locals);
+  void WriteKeys(const std::vector<HavokImportClip> &clips);
+  void ImportClips(std::vector<HavokImportClip> &clips);
+  void ResolveTracks(const hkaAnimation *ani, const hkaAnimationBinding *bind,
+                     std::vector<HavokSceneNode *> &trackNodes);
+};
+
+struct xmlSceneBone : xmlBone {
+  HavokSceneNode *ref;
+};
+
+// Animation range being exported, frames are inclusive
+struct HavokExportClip {
+  std::string name;
+  int32 start = 0;
+  int32 end = 0;
+};
+
+// Parses comma separated named frame ranges ("Walk 0-30, Run 31-60, 70-90").
+// Name is optional, unnamed ranges are called "Clip <index>".
+void ParseClipList(const std::string &list,
+                   std::vector<HavokExportClip> &clips);
+
+class HavokExportCore {
+public:
+  HavokScene &scene;
+  float inverseScale = 1.0f;
+  AffineTM inverseCorMat;
+  int32 animationStart = 0, animationEnd = 0, captureFrame = 0;
+  bool selectedOnly = false;
+  // Removes tracks, that keep reference pose over whole animation
+  bool optimizeTracks = false;
+  // Removes tracks matching reference pose, flattens constant channels
+  // and resamples tracks to lowest uniform frame count within tolerance
+  bool compressTracks = false;
+  // Skeleton is written along with animation. Without it, runtime has no
+  // matching reference pose, so compression keeps static tracks.
+  bool skeletonExported = true;
+  HavokTrackTolerance tolerance;
+  // 0 = use all hardware threads
+  size_t numThreads = 0;
+  // Optional, receives stage timings and counters
+  HavokStats *stats = nullptr;
+
+  HavokExportCore(HavokScene &scene_) : scene(scene_) {}
+
+  void SetupCorrection(float objectScale, const AffineTM &corMat);
+  void BuildSkeleton(xmlSkeleton *skel);
+  void ProcessAnimation(xmlSkeleton *skel, xmlAnimationBinding *binds,
+                        xmlInterleavedAnimation *anim);
+  // Samples scene once over frames of all clips, then builds one animation
+  // per clip. Bindings and animations are paired with clips by index.
+  void ProcessAnimations(xmlSkeleton *skel,
+                         const std::vector<HavokExportClip> &clips,
+                         const std::vector<xmlAnimationBinding *> &binds,
+                         const std::vector<xmlInterleavedAnimation *> &anims);
+  // Converts clip markers of scene into frame ranges, sorted by start
+  void GetSceneClips(std::vector<HavokExportClip> &clips);
+
+private:
+  struct SampledScene;
+
+  struct AddedBone {
+    xmlBone *bone;
+    AffineTM noScaleWorldTM;
+  };
+
+  typedef std::unordered_map<HavokSceneNode *, AddedBone> AddedBones;
+
+  struct BoneError {
+    xmlSceneBone *bone;
+    HavokTrackError error;
+  };
+
+  void AddBone(xmlSkeleton *skel, HavokSceneNode *nde, float captureTime,
+               AddedBones &addedBones);
+  // Removes static tracks, when removeStatic is set, and flattens constant
+  // channels. When unflattened is set, it receives copy of every flattened
+  // track before flattening. When removedErrors is set, it receives error
+  // of every removed track against reference pose.
+  void ReduceTracks(std::vector<xmlSceneBone *> &bones,
+                    std::vector<std::unique_ptr<HavokTrack>> &tracks,
+                    const std::vector<hkQTransform> &references,
+                    const HavokTrackTolerance &tol, bool removeStatic,
+                    std::vector<std::unique_ptr<HavokTrack>> *unflattened =
+                        nullptr,
+                    std::vector<BoneError> *removedErrors = nullptr);
+  // Error is measured against unflattened tracks, where available,
+  // and appended to errors.
+  void CompressTracks(
+      const std::vector<xmlSceneBone *> &bones,
+      std::vector<std::unique_ptr<HavokTrack>> &tracks,
+      const std::vector<std::unique_ptr<HavokTrack>> &unflattened,
+      std::vector<BoneError> &errors);
+  // Prints worst error of every channel, error of every bone is recorded
+  // into stats trace
+  void ReportTrackErrors(const HavokExportClip &clip,
+                         const std::vector<BoneError> &errors);
+  void SampleScene(xmlSkeleton *skel, const std::vector<HavokExportClip> &clips,
+                   SampledScene &sampled);
+  void BuildClip(const SampledScene &sampled, const HavokExportClip &clip,
+                 xmlAnimationBinding *binds, xmlInterleavedAnimation *anim);
+};
@@ -0,0 +1,411 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#include "HavokCore.h"
+#include "MemoryScene.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Regression tests of SDK free core, registered with ctest.
+// Every failed check is printed, process fails if any check failed.
+
+namespace {
+size_t numFailed = 0;
+
+void Check(bool condition, const char *expr, const char *file, int line) {
+  if (!condition) {
+    std::printf("%s:%d: check failed: %s\n", file, line, expr);
+    numFailed++;
+  }
+}
+
+#define CHECK(...) Check(!!(__VA_ARGS__), #__VA_ARGS__, __FILE__, __LINE__)
+
+const float epsilon = 0.0001f;
+
+bool Near(float v0, float v1, float eps = epsilon) {
+  return std::abs(v0 - v1) <= eps;
+}
+
+bool Near(const Vector4A16 &v0, const Vector4A16 &v1, float eps = epsilon) {
+  return Near(v0.X, v1.X, eps) && Near(v0.Y, v1.Y, eps) &&
+         Near(v0.Z, v1.Z, eps);
+}
+
+bool Near(const AffineTM &m0, const AffineTM &m1, float eps = epsilon) {
+  for (int r = 0; r < 4; r++) {
+    if (!Near(m0.GetRow(r), m1.GetRow(r), eps)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Angle between rotations in degrees
+float QuatAngle(const Vector4A16 &q0, const Vector4A16 &q1) {
+  const float dot = q0.X * q1.X + q0.Y * q1.Y + q0.Z * q1.Z + q0.W * q1.W;
+  return std::acos(std::min(std::abs(dot), 1.0f)) * 360.0f / 3.14159265f;
+}
+
+// Row vector convention: point * matrix
+Vector4A16 TransformPoint(const Vector4A16 &point, const AffineTM &mtx) {
+  return mtx.GetRow(0) * point.X + mtx.GetRow(1) * point.Y +
+         mtx.GetRow(2) * point.Z + mtx.GetTrans();
+}
+
+Vector4A16 AxisQuat(const Vector4A16 &axis, float degrees) {
+  const float halfAngle = degrees * 3.14159265f / 360.0f;
+  const float sinHalf = std::sin(halfAngle);
+  return Vector4A16(axis.X * sinHalf, axis.Y * sinHalf, axis.Z * sinHalf,
+                    std::cos(halfAngle));
+}
+
+hkQTransform MakeTransform(const Vector4A16 &translation) {
+  hkQTransform value;
+  value.translation = translation;
+  value.rotation = Vector4A16(0.0f, 0.0f, 0.0f, 1.0f);
+  value.scale = Vector4A16(1.0f, 1.0f, 1.0f, 0.0f);
+  return value;
+}
+
+void TestAffineTM() {
+  AffineTM rotZ;
+  rotZ.SetRotate(AxisQuat(Vector4A16(0.0f, 0.0f, 1.0f, 0.0f), 90.0f));
+
+  // Rows are images of axes, like Matrix3
+  CHECK(Near(rotZ.GetRow(0), Vector4A16(0.0f, 1.0f, 0.0f, 0.0f)));
+  CHECK(Near(rotZ.GetRow(1), Vector4A16(-1.0f, 0.0f, 0.0f, 0.0f)));
+  CHECK(Near(rotZ.GetRow(2), Vector4A16(0.0f, 0.0f, 1.0f, 0.0f)));
+
+  AffineTM move;
+  move.SetTrans(Vector4A16(1.0f, 2.0f, 3.0f, 0.0f));
+  const Vector4A16 point(1.0f, 0.0f, 0.0f, 0.0f);
+
+  // Left operand is applied first, like Matrix3
+  CHECK(Near(TransformPoint(point, rotZ * move),
+             Vector4A16(1.0f, 3.0f, 3.0f, 0.0f)));
+  CHECK(Near(TransformPoint(point, move * rotZ),
+             Vector4A16(-2.0f, 2.0f, 3.0f, 0.0f)));
+  CHECK(Near(TransformPoint(point, rotZ * move),
+             TransformPoint(TransformPoint(point, rotZ), move)));
+
+  AffineTM combined = rotZ;
+  combined *= move;
+  CHECK(Near(combined, rotZ * move));
+
+  AffineTM full;
+  full.SetRotate(AxisQuat(Vector4A16(0.6f, 0.0f, 0.8f, 0.0f), 37.0f));
+  full.Scale(Vector4A16(2.0f, 0.5f, 3.0f, 0.0f));
+  full.SetTrans(Vector4A16(-4.0f, 5.0f, 0.25f, 0.0f));
+  CHECK(Near(full * full.Inverse(), AffineTM()));
+  CHECK(Near(full.Inverse() * full, AffineTM()));
+
+  // Scale multiplies columns, so it's applied after rotation
+  AffineTM rotScaled = rotZ;
+  rotScaled.Scale(Vector4A16(2.0f, 0.5f, 3.0f, 0.0f));
+  CHECK(Near(TransformPoint(point, rotScaled),
+             Vector4A16(0.0f, 0.5f, 0.0f, 0.0f)));
+  CHECK(Near(rotScaled.GetScale(), Vector4A16(0.5f, 2.0f, 3.0f, 0.0f)));
+  rotScaled.NoScale();
+  CHECK(Near(rotScaled, rotZ));
+
+  // Quaternion product matches matrix product of its operands
+  const Vector4A16 q0 = AxisQuat(Vector4A16(1.0f, 0.0f, 0.0f, 0.0f), 30.0f);
+  const Vector4A16 q1 = AxisQuat(Vector4A16(0.0f, 1.0f, 0.0f, 0.0f), 70.0f);
+  AffineTM m0, m1, mProduct;
+  m0.SetRotate(q0);
+  m1.SetRotate(q1);
+  mProduct.SetRotate(QuatMultiply(q1, q0));
+  CHECK(Near(m0 * m1, mProduct));
+
+  AffineTM rotated;
+  rotated.SetRotate(q0);
+  const Vector4A16 qBack = rotated.GetRotation();
+  CHECK(Near(qBack, q0) && Near(qBack.W, q0.W));
+}
+
+void TestCorrectionMatrix() {
+  AffineTM corMat;
+  ParseCorrectionMatrix(corMat, "X-ZY");
+  CHECK(Near(corMat.GetRow(0), Vector4A16(1.0f, 0.0f, 0.0f, 0.0f)));
+  CHECK(Near(corMat.GetRow(1), Vector4A16(0.0f, 0.0f, -1.0f, 0.0f)));
+  CHECK(Near(corMat.GetRow(2), Vector4A16(0.0f, 1.0f, 0.0f, 0.0f)));
+  CHECK(Near(corMat.GetTrans(), Vector4A16()));
+
+  AffineTM flipped;
+  ParseCorrectionMatrix(flipped, "-X-Y-Z");
+  CHECK(Near(flipped.GetRow(0), Vector4A16(-1.0f, 0.0f, 0.0f, 0.0f)));
+  CHECK(Near(flipped.GetRow(1), Vector4A16(0.0f, -1.0f, 0.0f, 0.0f)));
+  CHECK(Near(flipped.GetRow(2), Vector4A16(0.0f, 0.0f, -1.0f, 0.0f)));
+}
+
+void TestClipList() {
+  std::vector<HavokExportClip> clips;
+  ParseClipList("Walk 0-30, Run Fast 31 - 60,70-90, 5, bad, 9-3", clips);
+  CHECK(clips.size() == 4);
+
+  if (clips.size() == 4) {
+    CHECK(clips[0].name == "Walk" && clips[0].start == 0 &&
+          clips[0].end == 30);
+    CHECK(clips[1].name == "Run Fast" && clips[1].start == 31 &&
+          clips[1].end == 60);
+    CHECK(clips[2].name == "Clip 2" && clips[2].start == 70 &&
+          clips[2].end == 90);
+    CHECK(clips[3].name == "Clip 3" && clips[3].start == 5 &&
+          clips[3].end == 5);
+  }
+
+  ParseClipList(" , ", clips);
+  CHECK(clips.empty());
+}
+
+void TestMotionList() {
+  std::vector<size_t> indices;
+  ParseMotionList("0, 2, 5-7", 10, indices);
+  CHECK(indices == std::vector<size_t>{0, 2, 5, 6, 7});
+
+  ParseMotionList("", 3, indices);
+  CHECK(indices == std::vector<size_t>{0, 1, 2});
+
+  // Out of range and reversed items are skipped
+  ParseMotionList("1, 4, 3-2, x", 4, indices);
+  CHECK(indices == std::vector<size_t>{1});
+}
+
+void TestClassifyTrack() {
+  const HavokTrackTolerance tolerance;
+  const hkQTransform reference =
+      MakeTransform(Vector4A16(1.0f, 2.0f, 3.0f, 0.0f));
+  HavokTrack track(10, reference);
+
+  CHECK(ClassifyTrack(track, reference, tolerance).IsStatic());
+
+  // Offset from reference, but not moving
+  for (auto &t : track) {
+    t.translation.X += 0.5f;
+  }
+
+  HavokTrackChannels channels = ClassifyTrack(track, reference, tolerance);
+  CHECK(!channels.IsStatic() && channels.HasConstant());
+  CHECK(channels.translation[0] == HavokChannelType::Constant);
+  CHECK(channels.rotation == HavokChannelType::Static);
+  CHECK(channels.scale[0] == HavokChannelType::Static);
+
+  for (size_t f = 0; f < track.size(); f++) {
+    track[f].translation.Y += f * 0.1f;
+  }
+
+  channels = ClassifyTrack(track, reference, tolerance);
+  CHECK(channels.translation[1] == HavokChannelType::Animated);
+
+  // Every component is within tolerance alone, but not together
+  HavokTrack jitter(10, reference);
+
+  for (size_t f = 0; f < jitter.size(); f += 2) {
+    jitter[f].translation =
+        jitter[f].translation + Vector4A16(0.0018f, 0.0018f, 0.0018f, 0.0f);
+  }
+
+  channels = ClassifyTrack(jitter, reference, tolerance);
+  CHECK(!channels.IsStatic());
+  CHECK(channels.translation[0] == HavokChannelType::Animated ||
+        channels.translation[1] == HavokChannelType::Animated ||
+        channels.translation[2] == HavokChannelType::Animated);
+
+  HavokTrack wobble(3, reference);
+  wobble[0].translation.Z += 0.0004f;
+  wobble[1].translation.Z += 0.0002f;
+  channels = ClassifyTrack(wobble, reference, tolerance);
+  CHECK(channels.IsStatic());
+
+  // Constant channel gets its middle value
+  HavokTrack shifted(3, MakeTransform(Vector4A16(5.0f, 0.0f, 0.0f, 0.0f)));
+  shifted[0].translation.X = 5.0008f;
+  shifted[2].translation.Y = 4.0f;
+  channels = ClassifyTrack(shifted, reference, tolerance);
+  CHECK(channels.translation[0] == HavokChannelType::Constant);
+  CHECK(channels.translation[1] == HavokChannelType::Animated);
+  FlattenConstantChannels(shifted, channels);
+
+  for (auto &t : shifted) {
+    CHECK(Near(t.translation.X, 5.0004f, 0.00001f));
+  }
+
+  CHECK(Near(shifted[2].translation.Y, 4.0f, 0.00001f));
+}
+
+void TestCompressedFrameCount() {
+  const HavokTrackTolerance tolerance;
+  HavokTrack linear, wave;
+
+  for (size_t f = 0; f < 101; f++) {
+    linear.push_back(MakeTransform(Vector4A16(f * 0.5f, 0.0f, 0.0f, 0.0f)));
+    wave.push_back(
+        MakeTransform(Vector4A16(0.0f, std::sin(f * 0.2f), 0.0f, 0.0f)));
+  }
+
+  HavokTrack linearSource = linear, waveSource = wave;
+  const size_t linearCount = FindCompressedFrameCount(
+      {&linear}, {&linearSource}, tolerance, 1);
+  CHECK(linearCount == 2);
+
+  const size_t waveCount =
+      FindCompressedFrameCount({&wave}, {&waveSource}, tolerance, 2);
+  CHECK(waveCount > 2 && waveCount <= 101);
+
+  HavokTrack resampled;
+  ResampleTrack(waveSource, waveCount, resampled);
+  CHECK(MeasureTrackError(waveSource, resampled).Within(tolerance));
+}
+
+void ExportScene(MemoryScene &scene, xmlHavokFile &hkFile,
+                 xmlAnimationContainer *aniCont,
+                 std::vector<xmlInterleavedAnimation *> &anims) {
+  HavokExportCore exporter(scene);
+  exporter.numThreads = 1;
+  xmlSkeleton *skel = hkFile.NewClass<xmlSkeleton>();
+  skel->name = "Reference";
+  exporter.BuildSkeleton(skel);
+  aniCont->skeletons.push_back(skel);
+
+  std::vector<HavokExportClip> clips;
+  exporter.GetSceneClips(clips);
+  std::vector<xmlAnimationBinding *> binds;
+
+  for (size_t c = 0; c < clips.size(); c++) {
+    xmlAnimationBinding *binding = hkFile.NewClass<xmlAnimationBinding>();
+    xmlInterleavedAnimation *anim = hkFile.NewClass<xmlInterleavedAnimation>();
+    binding->animation = anim;
+    binding->skeletonName = skel->name;
+    aniCont->animations.push_back(anim);
+    aniCont->bindings.push_back(binding);
+    binds.push_back(binding);
+    anims.push_back(anim);
+  }
+
+  exporter.ProcessAnimations(skel, clips, binds, anims);
+}
+
+// Scene -> export -> import into empty scene -> export, both exports must
+// match, same as HavokConvert does with packfiles.
+void TestRoundTrip() {
+  MemoryScene source;
+  source.frameRate = 30.0f;
+  MemorySceneNode *root = source.AddNode("Root");
+  MemorySceneNode *child = source.AddNode("Child", root);
+  root->localTM.SetTrans(Vector4A16(0.0f, 0.0f, 1.0f, 0.0f));
+
+  const size_t clipLengths[] = {20, 35};
+  std::vector<float> times;
+  std::vector<AffineTM> values;
+  size_t startFrame = 0;
+
+  for (size_t c = 0; c < 2; c++) {
+    for (size_t f = 0; f < clipLengths[c]; f++) {
+      const size_t frame = startFrame + f;
+      AffineTM value;
+      value.SetRotate(AxisQuat(Vector4A16(0.0f, 0.0f, 1.0f, 0.0f),
+                               frame * 3.0f));
+      value.SetTrans(Vector4A16(frame * 0.1f, 0.5f, 0.0f, 0.0f));
+      times.push_back(frame / source.frameRate);
+      values.push_back(value);
+    }
+
+    source.AddClipMarker("Motion " + std::to_string(c),
+                         startFrame / source.frameRate,
+                         (startFrame + clipLengths[c] - 1) / source.frameRate);
+    startFrame += clipLengths[c];
+  }
+
+  child->SetLocalKeys(times, values);
+
+  xmlHavokFile sourceFile = {};
+  xmlAnimationContainer *sourceCont =
+      sourceFile.NewClass<xmlAnimationContainer>();
+  std::vector<xmlInterleavedAnimation *> sourceAnims;
+  ExportScene(source, sourceFile, sourceCont, sourceAnims);
+
+  MemoryScene imported;
+  imported.frameRate = source.frameRate;
+  HavokImportCore importer(imported);
+  importer.numThreads = 1;
+  const hkaAnimationContainer *hkCont = sourceCont;
+
+  for (auto s : hkCont->Skeletons()) {
+    importer.LoadSkeleton(s);
+  }
+
+  std::vector<size_t> indices;
+  ParseMotionList("", hkCont->GetNumAnimations(), indices);
+  importer.LoadAnimations(hkCont, indices);
+
+  CHECK(imported.clipMarkers.size() == 2);
+
+  xmlHavokFile resultFile = {};
+  xmlAnimationContainer *resultCont =
+      resultFile.NewClass<xmlAnimationContainer>();
+  std::vector<xmlInterleavedAnimation *> resultAnims;
+  ExportScene(imported, resultFile, resultCont, resultAnims);
+
+  CHECK(sourceAnims.size() == 2);
+  CHECK(resultAnims.size() == sourceAnims.size());
+
+  for (size_t a = 0; a < std::min(resultAnims.size(), sourceAnims.size());
+       a++) {
+    const auto &sourceTracks = sourceAnims[a]->transforms;
+    const auto &resultTracks = resultAnims[a]->transforms;
+    CHECK(sourceTracks.size() == resultTracks.size());
+
+    for (size_t t = 0; t < std::min(sourceTracks.size(), resultTracks.size());
+         t++) {
+      const auto &sourceTrack = *sourceTracks[t];
+      const auto &resultTrack = *resultTracks[t];
+      CHECK(sourceTrack.size() == resultTrack.size());
+
+      for (size_t f = 0; f < std::min(sourceTrack.size(), resultTrack.size());
+           f++) {
+        CHECK(Near(sourceTrack[f].translation, resultTrack[f].translation) &&
+              Near(sourceTrack[f].scale, resultTrack[f].scale));
+        CHECK(QuatAngle(sourceTrack[f].rotation, resultTrack[f].rotation) <
+              0.01f);
+      }
+    }
+  }
+}
+} // namespace
+
+int main() {
+  TestAffineTM();
+  TestCorrectionMatrix();
+  TestClipList();
+  TestMotionList();
+  TestClassifyTrack();
+  TestCompressedFrameCount();
+  TestRoundTrip();
+
+  if (numFailed) {
+    std::printf("%zu checks failed\n", numFailed);
+    return 1;
+  }
+
+  std::printf("All checks passed\n");
+  return 0;
+}
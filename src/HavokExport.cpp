@@ -20,8 +20,14 @@
 #include "datas/master_printer.hpp"
 #include "havok_xml.hpp"
 
+#include "HavokCore.h"
+#include "HavokFileCache.h"
 #include "HavokMax.h"
+#include "MaxScene.h"
+#include <algorithm>
+#include <cctype>
 #include <impapi.h>
+#include <set>
 
 #define HavokExport_CLASS_ID Class_ID(0x2b020aa4, 0x5c7f7d58)
 static const TCHAR _className[] = _T("HavokExport");
@@ -47,12 +53,6 @@ public:
 
   void DoExport(const std::string &fileName, bool selectedOnly,
                 bool suppressPrompts);
-
-  float inverseScale = 1.0f;
-  Matrix3 inverseCorMat = true;
-
-  void ProcessAnimation(xmlSkeleton *skel, xmlAnimationBinding *binds,
-                        xmlInterleavedAnimation *anim);
 };
 
 class : public ClassDesc2 {
@@ -73,10 +73,12 @@ ClassDesc2 *GetHavokExportDesc() { return &HavokExportDesc; }
 //--- HavokImp -------------------------------------------------------
 HavokExport::HavokExport() {}
 
-int HavokExport::ExtCount() { return static_cast<int>(extensions.size()); }
+int HavokExport::ExtCount() {
+  return static_cast<int>(GetExtensionTable().size());
+}
 
 const TCHAR *HavokExport::Ext(int n) {
-  return std::next(extensions.begin(), n)->data();
+  return GetExtensionTable()[n].extension.data();
 }
 
 const TCHAR *HavokExport::LongDesc() { return _T("Havok Export"); }
@@ -101,229 +103,6 @@ BOOL HavokExport::SupportsOptions(int /*ext*/, DWORD /*options*/) {
   return TRUE;
 }
 
-struct xmlBoneMAX : xmlBone {
-  INode *ref;
-};
-
-thread_local static class : public ITreeEnumProc {
-  void AddBone(INode *nde) {
-    TimeValue captureFrame = ex->captureFrame * GetTicksPerFrame();
-    xmlBoneMAX *currentNode = new xmlBoneMAX();
-    currentNode->ID = static_cast<short>(skeleton->bones.size());
-    currentNode->name = std::to_string(nde->GetName());
-    currentNode->ref = nde;
-
-    INode *parentNode = nde->GetParentNode();
-    Matrix3 nodeTM = nde->GetNodeTM(captureFrame);
-
-    nodeTM.NoScale();
-
-    if (parentNode && !parentNode->IsRootNode()) {
-      for (auto &b : skeleton->bones) {
-        if (static_cast<xmlBoneMAX *>(b.get())->ref == parentNode) {
-          currentNode->parent = b.get();
-          Matrix3 parentTM =
-              static_cast<xmlBoneMAX *>(b.get())->ref->GetNodeTM(captureFrame);
-          parentTM.NoScale();
-          parentTM.Invert();
-          nodeTM *= parentTM;
-          break;
-        }
-      }
-    }
-
-    if (!currentNode->parent) {
-      nodeTM *= ex->inverseCorMat;
-    }
-    currentNode->transform.translation =
-        Vector4A16(reinterpret_cast<const Vector4 &>(nodeTM.GetTrans())) *
-        ex->inverseScale;
-    currentNode->transform.translation.W = 1.0f;
-    currentNode->transform.rotation =
-        Vector4A16(reinterpret_cast<Vector4 &>(static_cast<Quat>(nodeTM)))
-            .QConjugate();
-
-    skeleton->bones.emplace_back(currentNode);
-  }
-
-public:
-  xmlSkeleton *skeleton;
-  HavokExport *ex;
-  bool selectedOnly;
-
-  int callback(INode *node) {
-    if (!selectedOnly || (selectedOnly && node->Selected())) {
-      AddBone(node);
-    }
-
-    return TREE_CONTINUE;
-  }
-} iSceneScanner;
-
-bool CanSkipBone(INode *cNode) {
-  Control *ctr = cNode->GetTMController();
-  Control *posCtrl = ctr->GetPositionController();
-
-  if (!posCtrl) {
-    return false;
-  }
-
-  IKeyControl *posCtr = GetKeyControlInterface(posCtrl);
-
-  int numKeys = 0;
-
-  if (posCtr) {
-    numKeys |= posCtr->GetNumKeys();
-  } else {
-    posCtr = GetKeyControlInterface(posCtrl->GetXController());
-    numKeys |= posCtr->GetNumKeys();
-    posCtr = GetKeyControlInterface(posCtrl->GetYController());
-    numKeys |= posCtr->GetNumKeys();
-    posCtr = GetKeyControlInterface(posCtrl->GetZController());
-    numKeys |= posCtr->GetNumKeys();
-  }
-
-  Control *rotCtrl = ctr->GetRotationController();
-
-  if (!rotCtrl) {
-    return false;
-  }
-
-  IKeyControl *rotCtr = GetKeyControlInterface(rotCtrl);
-
-  if (rotCtr) {
-    numKeys |= rotCtr->GetNumKeys();
-  } else {
-    rotCtr = GetKeyControlInterface(rotCtrl->GetXController());
-    numKeys |= rotCtr->GetNumKeys();
-    rotCtr = GetKeyControlInterface(rotCtrl->GetYController());
-    numKeys |= rotCtr->GetNumKeys();
-    rotCtr = GetKeyControlInterface(rotCtrl->GetZController());
-    numKeys |= rotCtr->GetNumKeys();
-  }
-
-  Control *scaleCtrl = ctr->GetScaleController();
-
-  if (!scaleCtrl) {
-    return false;
-  }
-
-  IKeyControl *scaleCtr = GetKeyControlInterface(scaleCtrl);
-
-  if (scaleCtr) {
-    numKeys |= scaleCtr->GetNumKeys();
-  } else {
-    scaleCtr = GetKeyControlInterface(scaleCtrl->GetXController());
-    numKeys |= scaleCtr->GetNumKeys();
-    scaleCtr = GetKeyControlInterface(scaleCtrl->GetYController());
-    numKeys |= scaleCtr->GetNumKeys();
-    scaleCtr = GetKeyControlInterface(scaleCtrl->GetZController());
-    numKeys |= scaleCtr->GetNumKeys();
-  }
-
-  return numKeys < 2;
-}
-
-void HavokExport::ProcessAnimation(xmlSkeleton *skel,
-                                   xmlAnimationBinding *binds,
-                                   xmlInterleavedAnimation *anim) {
-  anim->animType = HK_INTERLEAVED_ANIMATION;
-
-  Interval captureIterval(animationStart * GetTicksPerFrame(),
-                          animationEnd * GetTicksPerFrame());
-
-  anim->duration = TicksToSec(captureIterval.End() - captureIterval.Start());
-  anim->annotations.reserve(skel->GetNumBones());
-
-  for (auto &b : skel->bones) {
-    xmlBoneMAX *cBone = static_cast<xmlBoneMAX *>(b.get());
-    INode *cNode = cBone->ref;
-
-    if (checked[Checked::CH_ANIOPTIMIZE] && visible[Visible::CH_ANIOPTIMIZE] &&
-        CanSkipBone(cNode)) {
-      continue;
-    }
-
-    binds->transformTrackToBoneIndices.push_back(cBone->ID);
-
-    xmlInterleavedAnimation::transform_container *aCont =
-        new xmlInterleavedAnimation::transform_container;
-    aCont->reserve(captureIterval.Duration() / GetTicksPerFrame());
-
-    Control *rotateControl = (Control *)CreateInstance(
-        CTRL_ROTATION_CLASS_ID, Class_ID(HYBRIDINTERP_ROTATION_CLASS_ID, 0));
-    IKeyControl *kCon = GetKeyControlInterface(rotateControl);
-
-    for (TimeValue t = captureIterval.Start(); t <= captureIterval.End();
-         t += GetTicksPerFrame()) {
-      Matrix3 lMat = cNode->GetNodeTM(t);
-      Matrix3 pMat;
-      INode *parentNode = cBone->parent ? cNode->GetParentNode() : nullptr;
-
-      if (parentNode && !parentNode->IsRootNode()) {
-        pMat = cNode->GetParentTM(t);
-        pMat.Invert();
-      } else {
-        pMat = inverseCorMat;
-      }
-
-      lMat *= pMat;
-
-      hkQTransform cTransform;
-
-      cTransform.scale =
-          Vector4A16(lMat.GetRow(0).Length(), lMat.GetRow(1).Length(),
-                     lMat.GetRow(2).Length(), 0.0f);
-
-      if (parentNode && !parentNode->IsRootNode()) {
-        pMat = cNode->GetParentTM(t);
-        pMat.NoScale();
-        pMat.Invert();
-      }
-
-      lMat = cNode->GetNodeTM(t);
-      lMat.NoScale();
-      lMat *= pMat;
-
-      ILinRotKey cKey;
-      cKey.time = t;
-      cKey.val = Quat(lMat).Conjugate();
-      kCon->AppendKey(&cKey);
-
-      cTransform.translation =
-          Vector4A16(reinterpret_cast<const Vector4 &>(lMat.GetTrans()));
-      cTransform.translation.W = 1.0f;
-      aCont->push_back(cTransform);
-      // TODO check scale
-    }
-
-    Control *rotateControl2 = (Control *)CreateInstance(
-        CTRL_ROTATION_CLASS_ID, Class_ID(LININTERP_ROTATION_CLASS_ID, 0));
-    rotateControl2->Copy(rotateControl);
-    IKeyControl *kCon2 = GetKeyControlInterface(rotateControl2);
-
-    for (int k = 0; k < kCon2->GetNumKeys(); k++) {
-      ILinRotKey cKey;
-      kCon2->GetKey(k, &cKey);
-
-      aCont->at(k).rotation =
-          Vector4A16(reinterpret_cast<const Vector4 &>(cKey.val));
-    }
-
-    if (aCont->size() == 1) {
-      for (auto &t : *aCont) {
-        aCont->push_back(aCont->at(0));
-      }
-    }
-
-    anim->transforms.emplace_back(aCont);
-
-    xmlAnnotationTrack annot;
-    annot.name = cBone->name;
-    anim->annotations.push_back(annot);
-  }
-}
-
 void SaveEnvData(xmlEnvironment *env, const std::string &fileName) {
   AFileInfo fleInfo(fileName);
   MSTR *curMaxFile = &GetCOREInterface()->GetCurFilePath();
@@ -363,13 +142,65 @@ void SaveEnvData(xmlEnvironment *env, const std::string &fileName) {
   env->storage.push_back(outPath);
 }
 
+// Inserts clip name before extension: "dir/file_clip.hkx"
+// Index above zero is appended to keep duplicate clip names apart
+static std::string ClipFileName(const std::string &fileName,
+                                const std::string &clipName, size_t index) {
+  static const std::string invalidChars = "<>:\"/\\|?*";
+  const size_t folderEnd = fileName.find_last_of("/\\");
+  size_t extBegin = fileName.find_last_of('.');
+
+  if (extBegin == fileName.npos ||
+      (folderEnd != fileName.npos && extBegin < folderEnd)) {
+    extBegin = fileName.size();
+  }
+
+  std::string safeName = clipName;
+
+  for (auto &c : safeName) {
+    if (invalidChars.find(c) != invalidChars.npos) {
+      c = '_';
+    }
+  }
+
+  if (index) {
+    safeName += "_" + std::to_string(index + 1);
+  }
+
+  return fileName.substr(0, extBegin) + "_" + safeName +
+         fileName.substr(extBegin);
+}
+
+// Windows paths are case insensitive
+static std::string FoldPath(std::string path) {
+  std::transform(path.begin(), path.end(), path.begin(), [](char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  });
+  return path;
+}
+
 void SwapLocale();
 
 void HavokExport::DoExport(const std::string &fileName, bool selectedOnly,
                            bool suppressPrompts) {
-  inverseScale = 1.0f / objectScale;
-  inverseCorMat = corMat;
-  inverseCorMat.Invert();
+  HavokStats stats;
+  MaxScene scene;
+  scene.stats = &stats;
+  HavokExportCore core(scene);
+  core.SetupCorrection(objectScale, ToAffineTM(corMat));
+  core.animationStart = animationStart;
+  core.animationEnd = animationEnd;
+  core.captureFrame = captureFrame;
+  core.selectedOnly = selectedOnly;
+  core.optimizeTracks =
+      checked[Checked::CH_ANIOPTIMIZE] && visible[Visible::CH_ANIOPTIMIZE];
+  core.compressTracks =
+      checked[Checked::CH_ANICOMPRESS] && visible[Visible::CH_ANICOMPRESS];
+  core.tolerance.position = positionTolerance;
+  core.tolerance.rotation = rotationTolerance;
+  core.tolerance.scale = scaleTolerance;
+  core.numThreads = std::max(numThreads, 0);
+  core.stats = &stats;
 
   xmlHavokFile hkFile = {};
   xmlRootLevelContainer *cont = hkFile.NewClass<xmlRootLevelContainer>();
@@ -380,12 +211,10 @@ void HavokExport::DoExport(const std::string &fileName, bool selectedOnly,
       !checked[Checked::CH_ANIMATION];
   xmlSkeleton *skel =
       useSkeleton ? hkFile.NewClass<xmlSkeleton>() : new xmlSkeleton;
+  core.skeletonExported = useSkeleton;
 
   skel->name = "Reference";
-  iSceneScanner.skeleton = skel;
-  iSceneScanner.ex = this;
-  iSceneScanner.selectedOnly = selectedOnly;
-  GetCOREInterface7()->GetScene()->EnumTree(&iSceneScanner);
+  core.BuildSkeleton(skel);
   cont->AddVariant(aniCont);
   cont->AddVariant(envData);
   SaveEnvData(envData, fileName);
@@ -394,30 +223,128 @@ void HavokExport::DoExport(const std::string &fileName, bool selectedOnly,
     aniCont->skeletons.push_back(skel);
   }
 
+  std::vector<std::unique_ptr<xmlHavokFile>> clipFiles;
+  std::vector<std::string> clipFileNames;
+
   if (checked[Checked::CH_ANIMATION]) {
-    xmlAnimationBinding *binding = hkFile.NewClass<xmlAnimationBinding>();
-    xmlInterleavedAnimation *anim = hkFile.NewClass<xmlInterleavedAnimation>();
-    binding->animation = anim;
-    aniCont->animations.push_back(binding->animation);
-    aniCont->bindings.push_back(binding);
-
-    if (checked[Checked::CH_ANISKELETON]) {
-      binding->skeletonName = skel->name;
+    const bool exportClips =
+        checked[Checked::CH_EXPORT_CLIPS] && visible[Visible::CH_EXPORT_CLIPS];
+    const bool separateFiles =
+        exportClips && checked[Checked::CH_SEPARATE_CLIPS];
+    std::vector<HavokExportClip> clips;
+
+    if (exportClips) {
+      ParseClipList(clipList, clips);
+
+      if (clips.empty()) {
+        core.GetSceneClips(clips);
+      }
+
+      if (clips.empty()) {
+        printwarning("[Havok] No clips found, exporting animation range.");
+      }
+    }
+
+    if (clips.empty()) {
+      HavokExportClip clip;
+      clip.start = animationStart;
+      clip.end = animationEnd;
+      clips.push_back(clip);
+    }
+
+    std::vector<xmlAnimationBinding *> bindings;
+    std::vector<xmlInterleavedAnimation *> anims;
+    std::set<std::string> usedFileNames{FoldPath(fileName)};
+
+    for (auto &c : clips) {
+      xmlHavokFile *clipFile = &hkFile;
+      xmlAnimationContainer *clipCont = aniCont;
+
+      // Clip files hold animation only, skeleton stays in main file
+      // Unnamed clips have no file suffix and stay in main file as well
+      if (separateFiles && !c.name.empty()) {
+        std::string clipFileName;
+
+        // Every clip needs its own file, so paths must be unique
+        for (size_t i = 0;; i++) {
+          clipFileName = ClipFileName(fileName, c.name, i);
+
+          if (usedFileNames.insert(FoldPath(clipFileName)).second) {
+            if (i) {
+              printwarning("[Havok] Duplicate clip name: "
+                           << c.name << ", writing to: " << clipFileName);
+            }
+
+            break;
+          }
+        }
+
+        clipFiles.emplace_back(new xmlHavokFile());
+        clipFileNames.push_back(clipFileName);
+        clipFile = clipFiles.back().get();
+        xmlRootLevelContainer *clipRoot =
+            clipFile->NewClass<xmlRootLevelContainer>();
+        clipCont = clipFile->NewClass<xmlAnimationContainer>();
+        xmlEnvironment *clipEnv = clipFile->NewClass<xmlEnvironment>();
+        clipRoot->AddVariant(clipCont);
+        clipRoot->AddVariant(clipEnv);
+        SaveEnvData(clipEnv, clipFileNames.back());
+      }
+
+      xmlAnimationBinding *binding = clipFile->NewClass<xmlAnimationBinding>();
+      xmlInterleavedAnimation *anim =
+          clipFile->NewClass<xmlInterleavedAnimation>();
+      binding->animation = anim;
+      clipCont->animations.push_back(binding->animation);
+      clipCont->bindings.push_back(binding);
+
+      if (checked[Checked::CH_ANISKELETON]) {
+        binding->skeletonName = skel->name;
+      }
+
+      bindings.push_back(binding);
+      anims.push_back(anim);
     }
 
-    ProcessAnimation(skel, binding, anim);
+    core.ProcessAnimations(skel, clips, bindings, anims);
+  }
+
+  {
+    HavokScopedTimer timer(&stats, "write xml");
+    hkFile.ToXML(std::to_string(fileName), toolset);
+
+    // HavokLib's writer isn't known to be reentrant, write files in order
+    for (size_t f = 0; f < clipFiles.size(); f++) {
+      clipFiles[f]->ToXML(std::to_string(clipFileNames[f]), toolset);
+    }
   }
 
-  hkFile.ToXML(std::to_string(fileName), toolset);
+  auto countWritten = [&](const std::string &path) {
+    size_t fileSize;
+    time_t modified;
+
+    if (GetFileStamp(path, fileSize, modified)) {
+      stats.Add(HavokCounter::BytesWritten, fileSize);
+    }
+  };
+
+  countWritten(fileName);
+
+  for (auto &f : clipFileNames) {
+    countWritten(f);
+  }
 
   if (!useSkeleton) {
     delete skel;
   }
+
+  ReportStats(stats, "Export");
 }
 
 int HavokExport::DoExport(const TCHAR *fileName, ExpInterface *, Interface *,
                           BOOL suppressPrompts, DWORD options) {
   SwapLocale();
+  UseExtensionPreset(fileName);
 
   if (!suppressPrompts)
     if (!SpawnExportDialog())
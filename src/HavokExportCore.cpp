@@ -0,0 +1,619 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#include "HavokCore.h"
+#include "HavokParallel.h"
+#include "datas/master_printer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <regex>
+#include <type_traits>
+
+static_assert(std::is_same<HavokTrack,
+                           xmlInterleavedAnimation::transform_container>::value,
+              "Track type must match xml transform container.");
+static_assert(sizeof(hkQTransform) == sizeof(Vector4A16) * 3,
+              "Rotations of a track must have stride of 3 vectors.");
+
+// Only numerical noise of sampled transforms is treated as static,
+// so moving bones are never dropped by track optimization.
+static HavokTrackTolerance StaticTolerance() {
+  HavokTrackTolerance retVal;
+  retVal.position = 1.0e-5f;
+  retVal.rotation = 1.0e-3f;
+  retVal.scale = 1.0e-5f;
+  return retVal;
+}
+
+void HavokExportCore::SetupCorrection(float objectScale,
+                                      const AffineTM &corMat) {
+  inverseScale = 1.0f / objectScale;
+  inverseCorMat = corMat.Inverse();
+}
+
+void HavokExportCore::AddBone(xmlSkeleton *skel, HavokSceneNode *nde,
+                              float captureTime, AddedBones &addedBones) {
+  xmlSceneBone *currentNode = new xmlSceneBone();
+  currentNode->ID = static_cast<short>(skel->bones.size());
+  currentNode->name = nde->GetName();
+  currentNode->ref = nde;
+
+  AffineTM worldTM = nde->GetWorldTM(captureTime);
+  worldTM.NoScale();
+  AffineTM nodeTM = worldTM;
+
+  // Parents are always enumerated before their children
+  auto foundParent = addedBones.find(nde->GetParent());
+
+  if (foundParent != addedBones.end()) {
+    currentNode->parent = foundParent->second.bone;
+    nodeTM *= foundParent->second.noScaleWorldTM.Inverse();
+  } else {
+    nodeTM *= inverseCorMat;
+  }
+
+  currentNode->transform.translation = nodeTM.GetTrans() * inverseScale;
+  currentNode->transform.translation.W = 1.0f;
+  currentNode->transform.rotation = nodeTM.GetRotation();
+
+  addedBones[nde] = {currentNode, worldTM};
+  skel->bones.emplace_back(currentNode);
+}
+
+void HavokExportCore::BuildSkeleton(xmlSkeleton *skel) {
+  HavokScopedTimer timer(stats, "build skeleton");
+  const float captureTime = captureFrame / scene.GetFrameRate();
+  std::vector<HavokSceneNode *> nodes;
+  scene.EnumNodes(nodes);
+
+  AddedBones addedBones;
+  addedBones.reserve(nodes.size());
+  skel->bones.reserve(skel->bones.size() + nodes.size());
+
+  for (auto n : nodes) {
+    if (!selectedOnly || n->IsSelected()) {
+      AddBone(skel, n, captureTime, addedBones);
+    }
+  }
+}
+
+void HavokExportCore::ReduceTracks(
+    std::vector<xmlSceneBone *> &bones,
+    std::vector<std::unique_ptr<HavokTrack>> &tracks,
+    const std::vector<hkQTransform> &references,
+    const HavokTrackTolerance &tol, bool removeStatic,
+    std::vector<std::unique_ptr<HavokTrack>> *unflattened,
+    std::vector<BoneError> *removedErrors) {
+  HavokScopedTimer timer(stats, "reduce tracks");
+  std::vector<HavokTrackChannels> channels(tracks.size());
+  std::vector<HavokTrackError> staticErrors(removedErrors ? tracks.size() : 0);
+
+  if (unflattened) {
+    unflattened->clear();
+    unflattened->resize(tracks.size());
+  }
+
+  ParallelFor(tracks.size(), numThreads, [&](size_t t) {
+    channels[t] = ClassifyTrack(*tracks[t], references[t], tol);
+
+    if (removedErrors && channels[t].IsStatic()) {
+      staticErrors[t] = MeasureTrackError(*tracks[t], {references[t]});
+    }
+
+    if (channels[t].IsStatic() || !channels[t].HasConstant()) {
+      return;
+    }
+
+    if (unflattened) {
+      (*unflattened)[t].reset(new HavokTrack(*tracks[t]));
+    }
+
+    FlattenConstantChannels(*tracks[t], channels[t]);
+  });
+
+  HavokChannelStats channelStats;
+  size_t numKept = 0;
+
+  for (size_t t = 0; t < tracks.size(); t++) {
+    channelStats.Add(channels[t]);
+
+    // Static tracks are left to skeleton reference pose
+    if (removeStatic && channels[t].IsStatic()) {
+      if (removedErrors) {
+        removedErrors->push_back({bones[t], staticErrors[t]});
+      }
+
+      continue;
+    }
+
+    tracks[numKept] = std::move(tracks[t]);
+    bones[numKept] = bones[t];
+
+    if (unflattened) {
+      (*unflattened)[numKept] = std::move((*unflattened)[t]);
+    }
+
+    numKept++;
+  }
+
+  printinfo("[Havok] Track reduction, static channels: "
+            << channelStats.numStatic
+            << ", constant channels: " << channelStats.numConstant
+            << ", animated channels: " << channelStats.numAnimated
+            << ", removed tracks: " << tracks.size() - numKept);
+
+  tracks.resize(numKept);
+  bones.resize(numKept);
+
+  if (unflattened) {
+    unflattened->resize(numKept);
+  }
+}
+
+void HavokExportCore::CompressTracks(
+    const std::vector<xmlSceneBone *> &bones,
+    std::vector<std::unique_ptr<HavokTrack>> &tracks,
+    const std::vector<std::unique_ptr<HavokTrack>> &unflattened,
+    std::vector<BoneError> &errors) {
+  HavokScopedTimer timer(stats, "compress tracks");
+
+  std::vector<HavokTrack *> inTracks;
+  // Sampled values, flattening error counts into compression error
+  std::vector<HavokTrack *> sourceTracks;
+
+  for (size_t t = 0; t < tracks.size(); t++) {
+    inTracks.push_back(tracks[t].get());
+    sourceTracks.push_back(t < unflattened.size() && unflattened[t]
+                               ? unflattened[t].get()
+                               : tracks[t].get());
+  }
+
+  const size_t numFrames = tracks.empty() ? 0 : tracks[0]->size();
+  size_t numOutFrames = numFrames;
+
+  if (numFrames >= 3) {
+    numOutFrames = FindCompressedFrameCount(inTracks, sourceTracks, tolerance,
+                                            numThreads);
+    const float ratio = static_cast<float>(numFrames) / numOutFrames;
+
+    printinfo("[Havok] Compressed tracks from "
+              << numFrames << " to " << numOutFrames
+              << " frames, ratio: " << ratio);
+  }
+
+  const size_t errorsBegin = errors.size();
+  errors.resize(errorsBegin + tracks.size());
+
+  ParallelFor(tracks.size(), numThreads, [&](size_t t) {
+    BoneError &cError = errors[errorsBegin + t];
+    cError.bone = bones[t];
+
+    if (numOutFrames >= numFrames) {
+      cError.error = MeasureTrackError(*sourceTracks[t], *tracks[t]);
+      return;
+    }
+
+    std::unique_ptr<HavokTrack> resampled(new HavokTrack);
+    ResampleTrack(*tracks[t], numOutFrames, *resampled);
+    cError.error = MeasureTrackError(*sourceTracks[t], *resampled);
+    tracks[t] = std::move(resampled);
+  });
+}
+
+void HavokExportCore::ReportTrackErrors(const HavokExportClip &clip,
+                                        const std::vector<BoneError> &errors) {
+  if (errors.empty()) {
+    return;
+  }
+
+  if (stats) {
+    const std::string prefix = clip.name.empty() ? "" : clip.name + ": ";
+
+    for (auto &e : errors) {
+      stats->AddRecord("track error", prefix + e.bone->name,
+                       {{"position", e.error.position},
+                        {"rotation", e.error.rotation},
+                        {"scale", e.error.scale}});
+    }
+  }
+
+  // Single summary per clip, worst bone of every channel
+  const BoneError *worstPosition = &errors[0];
+  const BoneError *worstRotation = &errors[0];
+  const BoneError *worstScale = &errors[0];
+
+  for (auto &e : errors) {
+    if (e.error.position > worstPosition->error.position) {
+      worstPosition = &e;
+    }
+
+    if (e.error.rotation > worstRotation->error.rotation) {
+      worstRotation = &e;
+    }
+
+    if (e.error.scale > worstScale->error.scale) {
+      worstScale = &e;
+    }
+  }
+
+  printinfo("[Havok] Max error, position: "
+            << worstPosition->error.position << " ("
+            << worstPosition->bone->name
+            << "), rotation: " << worstRotation->error.rotation << " deg ("
+            << worstRotation->bone->name
+            << "), scale: " << worstScale->error.scale << " ("
+            << worstScale->bone->name << ")");
+}
+
+// Scene transforms sampled once for all exported clips
+struct HavokExportCore::SampledScene {
+  struct Track {
+    xmlSceneBone *bone;
+    size_t slot;
+    // Index into parent inverses, noSlot for root bones
+    size_t parentIndex;
+  };
+
+  static const size_t noSlot = static_cast<size_t>(-1);
+  std::vector<Track> tracks;
+  size_t numSlots = 0;
+  int32 firstFrame = 0;
+  // Sample index of every frame from firstFrame, only frames used by clips
+  // are sampled.
+  std::vector<size_t> frameSamples;
+  // Skeleton capture frame, reference pose for track reduction
+  size_t referenceSample = 0;
+  // numSlots per sample
+  std::vector<AffineTM> worldTMs;
+  // Slot of every parent node, inverses are stored only for these,
+  // parentSlots.size() per sample
+  std::vector<size_t> parentSlots;
+  std::vector<AffineTM> parentInverses;
+  std::vector<AffineTM> parentNoScaleInverses;
+};
+
+void HavokExportCore::SampleScene(xmlSkeleton *skel,
+                                  const std::vector<HavokExportClip> &clips,
+                                  SampledScene &sampled) {
+  HavokScopedTimer timer(stats, "sample scene");
+  static const size_t noSlot = SampledScene::noSlot;
+  const float frameRate = scene.GetFrameRate();
+  const size_t numBones = skel->GetNumBones();
+  int32 lastFrame = 0;
+  bool hasFrames = false;
+
+  for (auto &c : clips) {
+    if (c.end < c.start) {
+      continue;
+    }
+
+    sampled.firstFrame = hasFrames ? std::min(sampled.firstFrame, c.start)
+                                   : c.start;
+    lastFrame = hasFrames ? std::max(lastFrame, c.end) : c.end;
+    hasFrames = true;
+  }
+
+  // Overlapping clips share samples, gaps between clips are skipped
+  const size_t numRangeFrames =
+      hasFrames ? lastFrame - sampled.firstFrame + 1 : 0;
+  sampled.frameSamples.assign(numRangeFrames, noSlot);
+
+  for (auto &c : clips) {
+    for (int32 f = c.start; f <= c.end; f++) {
+      sampled.frameSamples[f - sampled.firstFrame] = 0;
+    }
+  }
+
+  std::vector<float> sampleTimes;
+
+  for (size_t f = 0; f < numRangeFrames; f++) {
+    if (sampled.frameSamples[f] != noSlot) {
+      sampled.frameSamples[f] = sampleTimes.size();
+      sampleTimes.push_back((sampled.firstFrame + static_cast<int32>(f)) /
+                            frameRate);
+    }
+  }
+
+  sampled.referenceSample = sampleTimes.size();
+  sampleTimes.push_back(captureFrame / frameRate);
+
+  auto &tracks = sampled.tracks;
+  std::vector<HavokSceneNode *> sampledNodes;
+  std::unordered_map<HavokSceneNode *, size_t> nodeSlots;
+
+  // Parents of tracks are skeleton bones, so every node has single slot
+  tracks.reserve(numBones);
+  sampledNodes.reserve(numBones);
+  nodeSlots.reserve(numBones);
+
+  auto GetSlot = [&](HavokSceneNode *node) {
+    auto found = nodeSlots.find(node);
+
+    if (found != nodeSlots.end()) {
+      return found->second;
+    }
+
+    const size_t slot = sampledNodes.size();
+    nodeSlots[node] = slot;
+    sampledNodes.push_back(node);
+    return slot;
+  };
+
+  for (auto &b : skel->bones) {
+    xmlSceneBone *cBone = static_cast<xmlSceneBone *>(b.get());
+    HavokSceneNode *cNode = cBone->ref;
+    HavokSceneNode *parentNode = cBone->parent ? cNode->GetParent() : nullptr;
+    const size_t slot = GetSlot(cNode);
+    // Holds parent slot until parents are indexed
+    tracks.push_back({cBone, slot, parentNode ? GetSlot(parentNode) : noSlot});
+  }
+
+  // Each node is evaluated once per frame, parent inverses are shared
+  // by all of their children.
+  const size_t numSlots = sampled.numSlots = sampledNodes.size();
+  auto &parentSlots = sampled.parentSlots;
+  std::vector<size_t> slotParents(numSlots, noSlot);
+
+  for (auto &t : tracks) {
+    if (t.parentIndex == noSlot) {
+      continue;
+    }
+
+    size_t &parentIndex = slotParents[t.parentIndex];
+
+    if (parentIndex == noSlot) {
+      parentIndex = parentSlots.size();
+      parentSlots.push_back(t.parentIndex);
+    }
+
+    t.parentIndex = parentIndex;
+  }
+
+  const size_t numSamples = sampleTimes.size();
+  const size_t numParents = parentSlots.size();
+  auto &worldTMs = sampled.worldTMs;
+  auto &parentInverses = sampled.parentInverses;
+  auto &parentNoScaleInverses = sampled.parentNoScaleInverses;
+  worldTMs.resize(numSamples * numSlots);
+  parentInverses.resize(numSamples * numParents);
+  parentNoScaleInverses.resize(numSamples * numParents);
+
+  // Scene is accessed only from calling thread, everything past sampling
+  // is pure math and runs in parallel.
+  for (size_t f = 0; f < numSamples; f++) {
+    const float t = sampleTimes[f];
+
+    for (size_t s = 0; s < numSlots; s++) {
+      worldTMs[f * numSlots + s] = sampledNodes[s]->GetWorldTM(t);
+    }
+  }
+
+  ParallelFor(numSamples, numThreads, [&](size_t f) {
+    for (size_t p = 0; p < numParents; p++) {
+      const size_t cParent = f * numParents + p;
+      const AffineTM &worldTM = worldTMs[f * numSlots + parentSlots[p]];
+      parentInverses[cParent] = worldTM.Inverse();
+      AffineTM noScaleTM = worldTM;
+      noScaleTM.NoScale();
+      parentNoScaleInverses[cParent] = noScaleTM.Inverse();
+    }
+  });
+}
+
+void HavokExportCore::BuildClip(const SampledScene &sampled,
+                                const HavokExportClip &clip,
+                                xmlAnimationBinding *binds,
+                                xmlInterleavedAnimation *anim) {
+  HavokScopedTimer timer(stats, "build clip");
+  typedef SampledScene::Track Track;
+  anim->animType = HK_INTERLEAVED_ANIMATION;
+
+  // Frame range is inclusive
+  const size_t numFrames =
+      clip.end < clip.start ? 0 : clip.end - clip.start + 1;
+  const size_t numSlots = sampled.numSlots;
+  const size_t numParents = sampled.parentSlots.size();
+  anim->duration = (clip.end - clip.start) / scene.GetFrameRate();
+
+  if (!clip.name.empty()) {
+    printinfo("[Havok] Exporting clip: " << clip.name << " [" << clip.start
+                                         << ", " << clip.end << "]");
+  }
+
+  auto GetLocal = [&](const Track &t, size_t sample) {
+    const AffineTM &nodeTM = sampled.worldTMs[sample * numSlots + t.slot];
+    const bool hasParent = t.parentIndex != SampledScene::noSlot;
+    const size_t pSlot = sample * numParents + t.parentIndex;
+    AffineTM lMat =
+        nodeTM * (hasParent ? sampled.parentInverses[pSlot] : inverseCorMat);
+
+    hkQTransform cTransform;
+    cTransform.scale = lMat.GetScale();
+
+    lMat = nodeTM;
+    lMat.NoScale();
+    lMat *= hasParent ? sampled.parentNoScaleInverses[pSlot] : inverseCorMat;
+
+    cTransform.rotation = lMat.GetRotation();
+    cTransform.translation = lMat.GetTrans();
+    cTransform.translation.W = 1.0f;
+    return cTransform;
+  };
+
+  const size_t *clipSamples =
+      numFrames ? &sampled.frameSamples[clip.start - sampled.firstFrame]
+                : nullptr;
+
+  // Every bone writes only into its own preallocated slot,
+  // so output order doesn't depend on scheduling.
+  const size_t numTracks = sampled.tracks.size();
+  std::vector<std::unique_ptr<HavokTrack>> outTracks(numTracks);
+  std::vector<xmlSceneBone *> outBones(numTracks);
+  std::vector<hkQTransform> references(numTracks);
+
+  ParallelFor(numTracks, numThreads, [&](size_t i) {
+    const Track &t = sampled.tracks[i];
+    outBones[i] = t.bone;
+    outTracks[i].reset(new HavokTrack);
+    HavokTrack &aCont = *outTracks[i];
+    // Single frame tracks are duplicated on output
+    aCont.reserve(std::max<size_t>(numFrames, 2));
+
+    for (size_t f = 0; f < numFrames; f++) {
+      aCont.push_back(GetLocal(t, clipSamples[f]));
+    }
+
+    if (numFrames) {
+      MakeQuatsContinuous(&aCont[0].rotation, numFrames, 3);
+    }
+
+    // Skeleton bones are exported without scale
+    hkQTransform &reference = references[i] =
+        GetLocal(t, sampled.referenceSample);
+    reference.scale = Vector4A16(1.0f, 1.0f, 1.0f, 0.0f);
+  });
+
+  // Static tracks are detected from sampled values, so bones driven by
+  // constraints, expressions or IK are kept even without any keys.
+  if (compressTracks) {
+    std::vector<std::unique_ptr<HavokTrack>> unflattened;
+    // Removed tracks are measured first, compressed ones are appended
+    std::vector<BoneError> errors;
+    ReduceTracks(outBones, outTracks, references, tolerance,
+                 skeletonExported, &unflattened, &errors);
+    CompressTracks(outBones, outTracks, unflattened, errors);
+    ReportTrackErrors(clip, errors);
+  } else if (optimizeTracks) {
+    ReduceTracks(outBones, outTracks, references, StaticTolerance(), true);
+  }
+
+  binds->transformTrackToBoneIndices.reserve(outTracks.size());
+  anim->transforms.reserve(outTracks.size());
+  anim->annotations.reserve(outTracks.size());
+
+  for (size_t t = 0; t < outTracks.size(); t++) {
+    HavokTrack *aCont = outTracks[t].release();
+
+    if (aCont->size() == 1) {
+      aCont->push_back(aCont->at(0));
+    }
+
+    binds->transformTrackToBoneIndices.push_back(outBones[t]->ID);
+    anim->transforms.emplace_back(aCont);
+
+    xmlAnnotationTrack annot;
+    annot.name = outBones[t]->name;
+    anim->annotations.push_back(annot);
+  }
+}
+
+void HavokExportCore::ProcessAnimation(xmlSkeleton *skel,
+                                       xmlAnimationBinding *binds,
+                                       xmlInterleavedAnimation *anim) {
+  HavokExportClip clip;
+  clip.start = animationStart;
+  clip.end = animationEnd;
+  ProcessAnimations(skel, {clip}, {binds}, {anim});
+}
+
+void HavokExportCore::ProcessAnimations(
+    xmlSkeleton *skel, const std::vector<HavokExportClip> &clips,
+    const std::vector<xmlAnimationBinding *> &binds,
+    const std::vector<xmlInterleavedAnimation *> &anims) {
+  SampledScene sampled;
+  SampleScene(skel, clips, sampled);
+
+  for (size_t c = 0; c < clips.size(); c++) {
+    BuildClip(sampled, clips[c], binds[c], anims[c]);
+  }
+}
+
+void HavokExportCore::GetSceneClips(std::vector<HavokExportClip> &clips) {
+  std::vector<HavokClipMarker> markers;
+  scene.GetClipMarkers(markers);
+
+  std::stable_sort(markers.begin(), markers.end(),
+                   [](const HavokClipMarker &m0, const HavokClipMarker &m1) {
+                     return m0.start < m1.start;
+                   });
+
+  const float frameRate = scene.GetFrameRate();
+
+  for (auto &m : markers) {
+    HavokExportClip clip;
+    clip.name = m.name;
+    clip.start = static_cast<int32>(std::lround(m.start * frameRate));
+    clip.end = static_cast<int32>(std::lround(m.end * frameRate));
+    clips.push_back(clip);
+  }
+}
+
+void ParseClipList(const std::string &list,
+                   std::vector<HavokExportClip> &clips) {
+  clips.clear();
+  size_t cPos = 0;
+
+  while (cPos < list.size()) {
+    size_t nextPos = list.find(',', cPos);
+
+    if (nextPos == list.npos) {
+      nextPos = list.size();
+    }
+
+    const std::string item = list.substr(cPos, nextPos - cPos);
+    cPos = nextPos + 1;
+
+    if (item.find_first_not_of(" \t") == item.npos) {
+      continue;
+    }
+
+    // [name] first[-last], spaces around dash are allowed
+    static const std::regex itemRegex(
+        R"(^\s*(?:(.*?\S)\s+)?(-?\d+)(?:\s*-\s*(-?\d+))?\s*$)");
+    std::smatch match;
+    bool valid = std::regex_match(item, match, itemRegex);
+    long first = 0;
+    long last = 0;
+
+    if (valid) {
+      first = std::strtol(match[2].str().c_str(), nullptr, 10);
+      last = match[3].matched ? std::strtol(match[3].str().c_str(), nullptr, 10)
+                              : first;
+      valid = last >= first;
+    }
+
+    if (!valid) {
+      printwarning("[Havok] Invalid clip list item: " << item);
+      continue;
+    }
+
+    HavokExportClip clip;
+
+    if (match[1].matched) {
+      clip.name = match[1].str();
+    } else {
+      clip.name = "Clip " + std::to_string(clips.size());
+    }
+
+    clip.start = static_cast<int32>(first);
+    clip.end = static_cast<int32>(last);
+    clips.push_back(clip);
+  }
+}
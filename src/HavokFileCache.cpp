@@ -0,0 +1,183 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#include "HavokFileCache.h"
+#include "HavokParallel.h"
+#include "datas/master_printer.hpp"
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <string>
+#else
+#include <fstream>
+#include <unistd.h>
+#endif
+
+size_t GetResidentBytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS_EX counters{};
+
+  if (!GetProcessMemoryInfo(
+          GetCurrentProcess(),
+          reinterpret_cast<PROCESS_MEMORY_COUNTERS *>(&counters),
+          sizeof(counters))) {
+    return 0;
+  }
+
+  return counters.PrivateUsage;
+#else
+  std::ifstream statm("/proc/self/statm");
+  size_t totalPages = 0, residentPages = 0;
+
+  if (!(statm >> totalPages >> residentPages)) {
+    return 0;
+  }
+
+  return residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+bool GetFileStamp(const std::string &path, size_t &size, time_t &modified) {
+#ifdef _WIN32
+  // Paths are UTF-8, narrow stat would read them in ANSI codepage
+  const int pathLen = MultiByteToWideChar(
+      CP_UTF8, 0, path.data(), static_cast<int>(path.size()), nullptr, 0);
+
+  if (!pathLen) {
+    return false;
+  }
+
+  std::wstring widePath(pathLen, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path.data(), static_cast<int>(path.size()),
+                      &widePath[0], pathLen);
+  struct _stat64 fileStat;
+
+  if (_wstat64(widePath.c_str(), &fileStat)) {
+    return false;
+  }
+#else
+  struct stat fileStat;
+
+  if (stat(path.c_str(), &fileStat)) {
+    return false;
+  }
+#endif
+
+  size = static_cast<size_t>(fileStat.st_size);
+  modified = fileStat.st_mtime;
+  return true;
+}
+
+void HavokFileCache::SetBudget(size_t newBudget) {
+  std::lock_guard<std::mutex> lock(mutex);
+  budget = newBudget;
+  Evict();
+}
+
+void HavokFileCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  index.clear();
+  usage = 0;
+}
+
+void HavokFileCache::Remove(EntryList::iterator entry) {
+  usage -= entry->cost;
+  index.erase(entry->path);
+  entries.erase(entry);
+}
+
+void HavokFileCache::Evict() {
+  while (usage > budget && !entries.empty()) {
+    Remove(std::prev(entries.end()));
+  }
+}
+
+static HavokFileCache::FilePtr LoadFile(const std::string &path) {
+  std::lock_guard<std::mutex> lock(HavokLibMutex());
+  return HavokFileCache::FilePtr(IhkPackFile::Create(path));
+}
+
+HavokFileCache::FilePtr HavokFileCache::Get(const std::string &path) {
+  size_t fileSize = 0;
+  time_t modified = 0;
+
+  if (!GetFileStamp(path, fileSize, modified)) {
+    return LoadFile(path);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(path);
+
+    if (found != index.end()) {
+      auto entry = found->second;
+
+      if (entry->size == fileSize && entry->modified == modified) {
+        entries.splice(entries.begin(), entries, entry);
+        numHits++;
+        printinfo("[Havok] Using cached file: " << path);
+        return entry->file;
+      }
+
+      Remove(entry);
+    }
+
+    numMisses++;
+  }
+
+  // Parsed outside of cache lock, so lookups don't wait for parsing.
+  // Resident growth depends on other threads and heap reuse, so it's only
+  // logged, cost is the file size.
+  const size_t residentBefore = GetResidentBytes();
+  FilePtr file = LoadFile(path);
+  const size_t residentAfter = GetResidentBytes();
+  const size_t loadedBytes =
+      residentAfter > residentBefore ? residentAfter - residentBefore : 0;
+
+  printinfo("[Havok] Loaded " << path << ", file size: " << fileSize
+                              << " B, resident: " << loadedBytes << " B");
+
+  const size_t cost = fileSize;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (cost > budget) {
+    return file;
+  }
+
+  auto found = index.find(path);
+
+  if (found != index.end()) {
+    Remove(found->second);
+  }
+
+  entries.push_front({path, fileSize, modified, cost, file});
+  index[path] = entries.begin();
+  usage += cost;
+  Evict();
+
+  return file;
+}
+
+HavokFileCache &GetFileCache() {
+  static HavokFileCache cache;
+  return cache;
+}
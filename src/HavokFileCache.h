@@ -0,0 +1,74 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#pragma once
+#include "havok_api.hpp"
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Returns memory currently held by the process, 0 if unknown
+size_t GetResidentBytes();
+// Returns false, when file doesn't exist
+bool GetFileStamp(const std::string &path, size_t &size, time_t &modified);
+
+// Process wide cache of parsed packfiles, so repeated imports of the same
+// file skip reading and fix-ups. Entries are validated by file size and
+// modification time and evicted in least recently used order, once their
+// summed costs exceed budget. Cost is file size, which unlike measured
+// memory growth doesn't depend on other threads or heap reuse.
+class HavokFileCache {
+public:
+  typedef std::shared_ptr<IhkPackFile> FilePtr;
+
+  size_t numHits = 0;
+  size_t numMisses = 0;
+
+  // Budget in bytes, 0 disables caching
+  void SetBudget(size_t newBudget);
+  size_t GetBudget() const { return budget; }
+  size_t GetUsage() const { return usage; }
+  FilePtr Get(const std::string &path);
+  void Clear();
+
+private:
+  struct Entry {
+    std::string path;
+    size_t size;
+    time_t modified;
+    size_t cost;
+    FilePtr file;
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  std::mutex mutex;
+  EntryList entries;
+  std::unordered_map<std::string, EntryList::iterator> index;
+  size_t budget = 256 << 20;
+  size_t usage = 0;
+
+  void Evict();
+  void Remove(EntryList::iterator entry);
+};
+
+HavokFileCache &GetFileCache();
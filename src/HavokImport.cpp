@@ -20,7 +20,10 @@
 #include "datas/master_printer.hpp"
 #include "havok_api.hpp"
 
+#include "HavokCore.h"
+#include "HavokFileCache.h"
 #include "HavokMax.h"
+#include "MaxScene.h"
 
 #define HavokImport_CLASS_ID Class_ID(0xad115395, 0x924c02c0)
 static const TCHAR _className[] = _T("HavokImport");
@@ -44,11 +47,6 @@ public:
                BOOL suppressPrompts = FALSE) override;
 
   void DoImport(const std::string &fileName, bool suppressPrompts);
-
-  void LoadSkeleton(const hkaSkeleton *skel);
-  void LoadAnimation(const hkaAnimation *ani, const hkaAnimationBinding *bind);
-  void LoadRootMotion(const hkaAnimatedReferenceFrame *ani,
-                      const std::vector<float> &times);
 };
 
 class : public ClassDesc2 {
@@ -69,10 +67,12 @@ ClassDesc2 *GetHavokImportDesc() { return &HavokImportDesc; }
 //--- HavokImp -------------------------------------------------------
 HavokImport::HavokImport() {}
 
-int HavokImport::ExtCount() { return static_cast<int>(extensions.size()); }
+int HavokImport::ExtCount() {
+  return static_cast<int>(GetExtensionTable().size());
+}
 
 const TCHAR *HavokImport::Ext(int n) {
-  return std::next(extensions.begin(), n)->data();
+  return GetExtensionTable()[n].extension.data();
 }
 
 const TCHAR *HavokImport::LongDesc() { return _T("Havok Import"); }
@@ -93,346 +93,17 @@ unsigned int HavokImport::Version() { return HAVOKMAX_VERSIONINT; }
 
 void HavokImport::ShowAbout(HWND hWnd) { ShowAboutDLG(hWnd); }
 
-static const MSTR skelNameHint = _T("hkaSkeleton");
-static const MSTR boneNameHint = _T("hkaBone");
-
-void HavokImport::LoadSkeleton(const hkaSkeleton *skel) {
-  std::vector<INode *> nodes;
-  int currentBone = 0;
-
-  for (auto b : *skel->Bones()) {
-    TSTRING boneName = ToTSTRING(b->Name());
-    INode *node = GetCOREInterface()->GetINodeByName(boneName.c_str());
-
-    if (!node) {
-      Object *obj = static_cast<Object *>(
-          CreateInstance(HELPER_CLASS_ID, Class_ID(DUMMY_CLASS_ID, 0)));
-      node = GetCOREInterface()->CreateObjectNode(obj);
-      node->ShowBone(2);
-      node->SetWireColor(0x80ff);
-    }
-
-    Matrix3 nodeTM = {};
-    uni::RTSValue bneTM;
-    b->GetTM(bneTM);
-    nodeTM.SetRotate(
-        reinterpret_cast<const Quat &>(bneTM.rotation.QConjugate()));
-    nodeTM.SetTrans(
-        reinterpret_cast<const Point3 &>(bneTM.translation * objectScale));
-    const auto parentNode = b->Parent();
-    if (parentNode) {
-      const auto bIndex = parentNode->Index();
-      nodes[bIndex]->AttachChild(node);
-      nodeTM *= nodes[bIndex]->GetNodeTM(0);
-    } else
-      nodeTM *= corMat;
-
-    node->SetNodeTM(0, nodeTM);
-
-    node->SetName(ToBoneName(boneName));
-    nodes.push_back(node);
-    node->SetUserPropString(skelNameHint, ToTSTRING(skel->Name()).data());
-    node->SetUserPropString(boneNameHint, ToTSTRING(currentBone).c_str());
-
-    currentBone++;
-  }
-}
-
-static class : public ITreeEnumProc {
-  const MSTR skelNameHint = _T("hkaSkeleton");
-  const MSTR boneNameHint = _T("hkaBone");
-  const MSTR skelNameExclude = _T("ragdoll");
-
-public:
-  std::vector<INode *> bones;
-
-  void RescanBones() {
-    bones.clear();
-    GetCOREInterface7()->GetScene()->EnumTree(this);
-  }
-
-  INode *LookupNode(int ID) {
-    for (auto &b : bones)
-      if (b->UserPropExists(boneNameHint)) {
-        int _ID;
-        b->GetUserPropInt(boneNameHint, _ID);
-
-        if (_ID == ID)
-          return b;
-      }
-
-    return nullptr;
-  }
-
-  int callback(INode *node) override {
-    Object *refobj = node->EvalWorldState(0).obj;
-
-    if (node->UserPropExists(skelNameHint)) {
-      MSTR skelName;
-      node->GetUserPropString(skelNameHint, skelName);
-      skelName.toLower();
-
-      const int skelNameExcludeSize = skelNameExclude.Length();
-      bool found = true;
-
-      for (int s = 0; s < skelNameExcludeSize; s++)
-        if (skelName[s] != skelNameExclude[s]) {
-          found = false;
-          break;
-        }
-
-      if (found)
-        return TREE_CONTINUE;
-
-      bones.push_back(node);
-    }
-
-    return TREE_CONTINUE;
-  }
-} iBoneScanner;
-
-void HavokImport::LoadRootMotion(const hkaAnimatedReferenceFrame *ani,
-                                 const std::vector<float> &times) {
-  if (!ani) {
-    return;
-  }
-
-  std::vector<INode *> rootNodes;
-  std::copy_if(iBoneScanner.bones.begin(), iBoneScanner.bones.end(),
-               std::back_inserter(rootNodes), [](INode *item) {
-                 auto pNode = item->GetParentNode();
-
-                 if (!pNode || pNode->IsRootNode()) {
-                   return true;
-                 }
-
-                 return false;
-               });
-
-  for (auto r : rootNodes) {
-    std::vector<Matrix3> cMats;
-    cMats.reserve(times.size());
-
-    for (auto t : times) {
-      cMats.emplace_back(r->GetNodeTM(SecToTicks(t)));
-    }
-
-    size_t cTime = 0;
-    Control *cnt = r->GetTMController();
-    AnimateOn();
-
-    for (auto t : times) {
-      hkQTransform trans;
-      ani->GetValue(trans, t);
-
-      Matrix3 cMat(true);
-      Quat &cRotation = reinterpret_cast<Quat &>(trans.rotation.QConjugate());
-      auto cTrans = reinterpret_cast<Point3 &>(trans.translation * objectScale);
-      cMat.SetRotate(cRotation);
-      cMat.SetTrans(cTrans);
-      auto trueTM = cMats[cTime++] * Inverse(corMat);
-
-      SetXFormPacket packet(trueTM * cMat * corMat);
-
-      cnt->SetValue(SecToTicks(t), &packet);
-    }
-
-    AnimateOff();
-  }
-}
-
-void HavokImport::LoadAnimation(const hkaAnimation *ani,
-                                const hkaAnimationBinding *bind) {
-  if (!ani) {
-    printerror("[Havok] Unregistered animation format.");
-    return;
-  }
-
-  /*if (!ani->IsDecoderSupported()) {
-    printerror("[Havok] Usupported animation type: ",
-               << ani->GetAnimationTypeName());
-    return;
-  }*/
-
-  iBoneScanner.RescanBones();
-
-  TimeValue numTicks = SecToTicks(ani->Duration());
-  TimeValue ticksPerFrame = GetTicksPerFrame();
-  TimeValue overlappingTicks = numTicks % ticksPerFrame;
-
-  if (overlappingTicks > (ticksPerFrame / 2)) {
-    numTicks += ticksPerFrame - overlappingTicks;
-  } else {
-    numTicks -= overlappingTicks;
-  }
-  Interval aniRange(0, numTicks);
-  GetCOREInterface()->SetAnimRange(aniRange);
-
-  std::vector<float> frameTimes;
-
-  for (TimeValue v = 0; v <= aniRange.End(); v += GetTicksPerFrame()) {
-    frameTimes.push_back(TicksToSec(v));
-  }
-
-  const auto numBones = ani->GetNumOfTransformTracks();
-  BlendHint blendType = bind ? bind->GetBlendHint() : BlendHint::NORMAL;
-
-  if (additiveOverride) {
-    blendType = static_cast<BlendHint>(additiveOverride);
-  }
-
-  std::vector<Matrix3> addTMs(numBones, true);
-
-  if (blendType != BlendHint::NORMAL) {
-    for (int curBone = 0; curBone < numBones; curBone++) {
-      INode *node = nullptr;
-      TSTRING boneName;
-
-      if (ani->GetNumAnnotations()) {
-        hkaAnnotationTrackPtr annot = ani->GetAnnotation(curBone);
-        boneName = ToTSTRING(annot.get()->GetName());
-        node = GetCOREInterface()->GetINodeByName(boneName.c_str());
-      }
-
-      if (!node && bind) {
-        node = iBoneScanner.LookupNode(
-            bind->GetTransformTrackToBoneIndex(curBone));
-      }
-
-      if (!node) {
-        continue;
-      }
-
-      Matrix3 inPacket = node->GetNodeTM(0);
-
-      if (!node->GetParentNode()->IsRootNode()) {
-        Matrix3 parentTM = node->GetParentTM(0);
-        parentTM.Invert();
-        inPacket *= parentTM;
-      }
-
-      addTMs[curBone] = inPacket;
-    }
-  }
-
-  const auto tracks = ani->Tracks();
-
-  for (int curBone = 0; curBone < numBones; curBone++) {
-    INode *node = nullptr;
-    es::string_view bneNameRaw;
-
-    if (ani->GetNumAnnotations()) {
-      hkaAnnotationTrackPtr annot = ani->GetAnnotation(curBone);
-      bneNameRaw = annot.get()->GetName();
-      TSTRING boneName = ToTSTRING(bneNameRaw);
-      node = GetCOREInterface()->GetINodeByName(boneName.c_str());
-    }
-
-    if (!node) {
-      if (bind && bind->GetNumTransformTrackToBoneIndices()) {
-        node = iBoneScanner.LookupNode(
-            bind->GetTransformTrackToBoneIndex(curBone));
-      } else {
-        node = iBoneScanner.LookupNode(curBone);
-      }
-    }
-
-    if (!node) {
-      if (bneNameRaw.length()) {
-        printwarning("[Havok] Couldn't find bone: " << bneNameRaw);
-      } else if (bind && bind->GetNumTransformTrackToBoneIndices()) {
-        printwarning("[Havok] Couldn't find hkaBone: "
-                     << bind->GetTransformTrackToBoneIndex(curBone));
-      } else {
-        printwarning("[Havok] Couldn't find hkaBone: " << curBone);
-      }
-
-      continue;
-    }
-
-    Control *cnt = node->GetTMController();
-
-    if (cnt->GetPositionController()->ClassID() !=
-        Class_ID(LININTERP_POSITION_CLASS_ID, 0)) {
-      cnt->SetPositionController((Control *)CreateInstance(
-          CTRL_POSITION_CLASS_ID, Class_ID(LININTERP_POSITION_CLASS_ID, 0)));
-    }
-
-    if (cnt->GetRotationController()->ClassID() !=
-        Class_ID(HYBRIDINTERP_ROTATION_CLASS_ID, 0)) {
-      cnt->SetRotationController((Control *)CreateInstance(
-          CTRL_ROTATION_CLASS_ID, Class_ID(HYBRIDINTERP_ROTATION_CLASS_ID, 0)));
-    }
-
-    if (cnt->GetScaleController()->ClassID() !=
-        Class_ID(LININTERP_SCALE_CLASS_ID, 0)) {
-      cnt->SetScaleController((Control *)CreateInstance(
-          CTRL_SCALE_CLASS_ID, Class_ID(LININTERP_SCALE_CLASS_ID, 0)));
-    }
-
-    SuspendAnimate();
-    AnimateOn();
-
-    const auto track = tracks->At(curBone);
-
-    for (auto &t : frameTimes) {
-      hkQTransform trans;
-      track->GetValue(trans, t);
-
-      Matrix3 cMat;
-      Quat &cRotation = reinterpret_cast<Quat &>(trans.rotation.QConjugate());
-      auto cTrans = reinterpret_cast<Point3 &>(trans.translation * objectScale);
-
-      if (blendType == BlendHint::ADDITIVE_DEPRECATED) {
-        cMat.SetRotate(Quat(addTMs[curBone]) + cRotation);
-        cMat.SetTrans(cTrans + addTMs[curBone].GetTrans());
-      } else if (blendType == BlendHint::ADDITIVE) {
-        cMat.SetRotate(cRotation + Quat(addTMs[curBone]));
-        cMat.SetTrans(cTrans + addTMs[curBone].GetTrans());
-      } else {
-        cMat.SetRotate(cRotation);
-        cMat.SetTrans(cTrans);
-      }
-
-      if (!checked[Checked::CH_DISABLE_SCALE]) {
-        cMat.Scale(reinterpret_cast<Point3 &>(trans.scale));
-      }
-
-      if (node->GetParentNode()->IsRootNode()) {
-        cMat *= corMat;
-      } else if (!checked[Checked::CH_DISABLE_SCALE]) {
-        Matrix3 pAbsMat = node->GetParentTM(SecToTicks(t));
-        Point3 nScale = {pAbsMat.GetRow(0).Length(), pAbsMat.GetRow(1).Length(),
-                         pAbsMat.GetRow(2).Length()};
-
-        for (int s = 0; s < 3; s++) {
-          if (!nScale[s]) {
-            nScale[s] = FLT_EPSILON;
-          }
-        }
-        Point3 fracPos = cMat.GetTrans() / nScale;
-        nScale = 1.f - nScale;
-        cMat.Translate(fracPos * nScale);
-      }
-
-      SetXFormPacket packet(cMat);
-
-      cnt->SetValue(SecToTicks(t), &packet);
-    }
-
-    AnimateOff();
-
-    Control *rotControl = (Control *)CreateInstance(
-        CTRL_ROTATION_CLASS_ID, Class_ID(LININTERP_ROTATION_CLASS_ID, 0));
-    rotControl->Copy(cnt->GetRotationController());
-    cnt->GetRotationController()->Copy(rotControl);
+void HavokImport::DoImport(const std::string &fileName, bool suppressPrompts) {
+  HavokStats stats;
+  HavokFileCache &fileCache = GetFileCache();
+  fileCache.SetBudget(static_cast<size_t>(std::max(cacheBudget, 0)) << 20);
+  HavokFileCache::FilePtr pFile;
+
+  {
+    HavokScopedTimer timer(&stats, "file parse");
+    pFile = fileCache.Get(std::to_string(fileName));
   }
 
-  LoadRootMotion(ani->GetExtractedMotion(), frameTimes);
-}
-
-void HavokImport::DoImport(const std::string &fileName, bool suppressPrompts) {
-  auto pFile = IhkPackFile::Create(std::to_string(fileName));
   const hkRootLevelContainer *rootCont = pFile->GetRootLevelContainer();
 
   for (auto &v : *rootCont) {
@@ -442,23 +113,41 @@ void HavokImport::DoImport(const std::string &fileName, bool suppressPrompts) {
       numAnimations = aniCont->GetNumAnimations();
 
       if (!suppressPrompts) {
+        HavokScopedTimer timer(&stats, "dialog");
+
         if (!SpawnImportDialog()) {
           return;
         }
       }
 
+      MaxScene scene;
+      scene.stats = &stats;
+      HavokImportCore core(scene);
+      core.objectScale = objectScale;
+      core.corMat = ToAffineTM(corMat);
+      core.disableScale = checked[Checked::CH_DISABLE_SCALE];
+      core.additiveOverride = additiveOverride;
+      core.numThreads = std::max(numThreads, 0);
+      core.stats = &stats;
+
       for (auto s : aniCont->Skeletons()) {
-        LoadSkeleton(s);
+        core.LoadSkeleton(s);
       }
 
-      if (numAnimations) {
-        LoadAnimation(aniCont->GetAnimation(motionIndex),
-                      aniCont->GetNumBindings()
-                          ? aniCont->GetBinding(motionIndex)
-                          : nullptr);
+      if (numAnimations && checked[Checked::CH_ALL_MOTIONS]) {
+        std::vector<size_t> indices;
+        ParseMotionList(motionList, numAnimations, indices);
+        core.LoadAnimations(aniCont, indices);
+      } else if (numAnimations) {
+        core.LoadAnimation(aniCont->GetAnimation(motionIndex),
+                           aniCont->GetNumBindings()
+                               ? aniCont->GetBinding(motionIndex)
+                               : nullptr);
       }
     }
   }
+
+  ReportStats(stats, "Import");
 }
 
 void SwapLocale() {
@@ -476,6 +165,7 @@ void SwapLocale() {
 int HavokImport::DoImport(const TCHAR *fileName, ImpInterface * /*importerInt*/,
                           Interface * /*ip*/, BOOL suppressPrompts) {
   SwapLocale();
+  UseExtensionPreset(fileName);
   TSTRING filename_ = fileName;
 
   try {
@@ -0,0 +1,777 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#include "HavokCore.h"
+#include "HavokParallel.h"
+#include "datas/master_printer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+
+static const std::string skelNameHint = "hkaSkeleton";
+static const std::string boneNameHint = "hkaBone";
+static const std::string skelNameExclude = "ragdoll";
+
+static std::string FoldName(std::string name) {
+  std::transform(name.begin(), name.end(), name.begin(),
+                 [](char c) { return static_cast<char>(std::tolower(c)); });
+  return name;
+}
+
+void HavokNameIndex::Rebuild(const std::vector<HavokSceneNode *> &nodes) {
+  names.clear();
+  foldedNames.clear();
+  names.reserve(nodes.size());
+  foldedNames.reserve(nodes.size());
+
+  for (auto n : nodes) {
+    AddNode(n);
+  }
+}
+
+void HavokNameIndex::AddNode(HavokSceneNode *node) {
+  const std::string name = node->GetName();
+  names.emplace(name, node);
+  foldedNames.emplace(FoldName(name), node);
+}
+
+void HavokNameIndex::RenameNode(HavokSceneNode *node,
+                                const std::string &name) {
+  const std::string oldName = node->GetName();
+
+  if (oldName == name) {
+    return;
+  }
+
+  auto found = names.find(oldName);
+
+  if (found != names.end() && found->second == node) {
+    names.erase(found);
+  }
+
+  found = foldedNames.find(FoldName(oldName));
+
+  if (found != foldedNames.end() && found->second == node) {
+    foldedNames.erase(found);
+  }
+
+  node->SetName(name);
+  AddNode(node);
+}
+
+HavokSceneNode *HavokNameIndex::LookupNode(const std::string &name) {
+  numLookups++;
+  auto found = names.find(name);
+
+  if (found != names.end()) {
+    return found->second;
+  }
+
+  found = foldedNames.find(FoldName(name));
+
+  if (found != foldedNames.end()) {
+    return found->second;
+  }
+
+  numMisses++;
+  return nullptr;
+}
+
+void HavokBoneScanner::RescanBones(const std::vector<HavokSceneNode *> &nodes) {
+  bones.clear();
+  boneIndex.clear();
+  skeletonIndex.clear();
+  numLookups = 0;
+  numMisses = 0;
+
+  for (auto n : nodes) {
+    std::string skelName;
+
+    if (!n->GetUserProp(skelNameHint, skelName)) {
+      continue;
+    }
+
+    if (!FoldName(skelName).compare(0, skelNameExclude.size(),
+                                    skelNameExclude)) {
+      continue;
+    }
+
+    bones.push_back(n);
+    std::string boneID;
+
+    if (n->GetUserProp(boneNameHint, boneID)) {
+      const int ID = std::atoi(boneID.data());
+      // First scanned node wins, same as linear search did
+      boneIndex.emplace(ID, n);
+      skeletonIndex[skelName].emplace(ID, n);
+    }
+  }
+}
+
+HavokSceneNode *HavokBoneScanner::LookupNode(int ID) {
+  numLookups++;
+  auto found = boneIndex.find(ID);
+
+  if (found == boneIndex.end()) {
+    numMisses++;
+    return nullptr;
+  }
+
+  return found->second;
+}
+
+HavokSceneNode *HavokBoneScanner::LookupNode(const std::string &skeletonName,
+                                             int ID) {
+  auto foundSkel = skeletonIndex.find(skeletonName);
+
+  if (foundSkel != skeletonIndex.end()) {
+    auto found = foundSkel->second.find(ID);
+
+    if (found != foundSkel->second.end()) {
+      numLookups++;
+      return found->second;
+    }
+  }
+
+  return LookupNode(ID);
+}
+
+void HavokImportCore::ScanScene() {
+  HavokScopedTimer timer(stats, "scan scene");
+  std::vector<HavokSceneNode *> nodes;
+  scene.EnumNodes(nodes);
+  CountStat(stats, HavokCounter::ScannedNodes, nodes.size());
+  nameIndex.Rebuild(nodes);
+  boneScanner.RescanBones(nodes);
+  sceneScanned = true;
+}
+
+void HavokImportCore::LoadSkeleton(const hkaSkeleton *skel) {
+  if (!sceneScanned) {
+    ScanScene();
+  }
+
+  HavokScopedTimer timer(stats, "load skeleton");
+  const size_t baseLookups = nameIndex.numLookups;
+  std::vector<HavokSceneNode *> nodes;
+  const std::string skelName = skel->Name().to_string();
+  int currentBone = 0;
+
+  for (auto b : *skel->Bones()) {
+    const std::string boneName = b->Name().to_string();
+    HavokSceneNode *node = nameIndex.LookupNode(boneName);
+    const bool newNode = !node;
+
+    if (newNode) {
+      node = scene.CreateBone();
+    }
+
+    AffineTM nodeTM;
+    uni::RTSValue bneTM;
+    b->GetTM(bneTM);
+    nodeTM.SetRotate(bneTM.rotation);
+    nodeTM.SetTrans(bneTM.translation * objectScale);
+    const auto parentNode = b->Parent();
+
+    if (parentNode && static_cast<size_t>(parentNode->Index()) < nodes.size()) {
+      const auto bIndex = parentNode->Index();
+      nodes[bIndex]->AttachChild(node);
+      nodeTM *= nodes[bIndex]->GetWorldTM(0);
+    } else {
+      nodeTM *= corMat;
+    }
+
+    node->SetWorldTM(0, nodeTM);
+
+    if (newNode) {
+      node->SetName(boneName);
+      nameIndex.AddNode(node);
+    } else {
+      // Node found by case folded name must be reachable by exact name
+      nameIndex.RenameNode(node, boneName);
+    }
+
+    nodes.push_back(node);
+    node->SetUserProp(skelNameHint, skelName);
+    node->SetUserProp(boneNameHint, std::to_string(currentBone));
+
+    currentBone++;
+  }
+
+  CountStat(stats, HavokCounter::NameResolves,
+            nameIndex.numLookups - baseLookups);
+}
+
+void HavokImportCore::ResolveTracks(const hkaAnimation *ani,
+                                    const hkaAnimationBinding *bind,
+                                    std::vector<HavokSceneNode *> &trackNodes) {
+  HavokScopedTimer timer(stats, "resolve tracks");
+  const size_t baseLookups = nameIndex.numLookups + boneScanner.numLookups;
+  const size_t baseNameMisses = nameIndex.numMisses;
+  const size_t baseBoneMisses = boneScanner.numMisses;
+  const auto numBones = ani->GetNumOfTransformTracks();
+  const std::string skelName =
+      bind ? bind->GetSkeletonName().to_string() : std::string{};
+  const bool useBinding = bind && bind->GetNumTransformTrackToBoneIndices();
+  trackNodes.resize(numBones);
+
+  for (int curBone = 0; curBone < numBones; curBone++) {
+    HavokSceneNode *node = nullptr;
+    es::string_view bneNameRaw;
+
+    if (ani->GetNumAnnotations()) {
+      hkaAnnotationTrackPtr annot = ani->GetAnnotation(curBone);
+      bneNameRaw = annot.get()->GetName();
+      node = nameIndex.LookupNode(bneNameRaw.to_string());
+    }
+
+    if (!node) {
+      if (useBinding) {
+        node = boneScanner.LookupNode(
+            skelName, bind->GetTransformTrackToBoneIndex(curBone));
+      } else {
+        node = boneScanner.LookupNode(skelName, curBone);
+      }
+    }
+
+    if (!node) {
+      if (bneNameRaw.length()) {
+        printwarning("[Havok] Couldn't find bone: " << bneNameRaw);
+      } else if (useBinding) {
+        printwarning("[Havok] Couldn't find hkaBone: "
+                     << bind->GetTransformTrackToBoneIndex(curBone));
+      } else {
+        printwarning("[Havok] Couldn't find hkaBone: " << curBone);
+      }
+    }
+
+    trackNodes[curBone] = node;
+  }
+
+  CountStat(stats, HavokCounter::NameResolves,
+            nameIndex.numLookups + boneScanner.numLookups - baseLookups);
+  CountStat(stats, HavokCounter::NameMisses,
+            nameIndex.numMisses - baseNameMisses);
+  CountStat(stats, HavokCounter::BoneIndexMisses,
+            boneScanner.numMisses - baseBoneMisses);
+}
+
+struct DecodeJob {
+  HavokImportClip *clip;
+  size_t track;
+};
+
+static void DecodeJobs(const std::vector<DecodeJob> &jobs, size_t numThreads) {
+  // Tracks are decoded in blocks, so neighbouring samples of one frame
+  // are mostly written by the same worker.
+  ParallelFor(
+      jobs.size(), numThreads,
+      [&](size_t curJob) {
+        HavokImportClip &clip = *jobs[curJob].clip;
+        const size_t curTrack = jobs[curJob].track;
+        const size_t numTracks = clip.trackNodes.size();
+        const auto track = clip.ani->Tracks()->At(curTrack);
+
+        for (size_t f = 0; f < clip.times.size(); f++) {
+          track->GetValue(clip.samples[f * numTracks + curTrack],
+                          clip.times[f]);
+        }
+      },
+      4);
+}
+
+void HavokImportCore::DecodeClips(std::vector<HavokImportClip> &clips) {
+  HavokScopedTimer timer(stats, "decode tracks");
+  std::vector<DecodeJob> jobs;
+  size_t numSamples = 0;
+
+  for (auto &c : clips) {
+    const size_t numTracks = c.trackNodes.size();
+    c.samples.resize(c.times.size() * numTracks);
+
+    for (size_t t = 0; t < numTracks; t++) {
+      if (c.trackNodes[t]) {
+        jobs.push_back({&c, t});
+        numSamples += c.times.size();
+      }
+    }
+  }
+
+  CountStat(stats, HavokCounter::DecodedSamples, numSamples);
+
+  DecodeJobs(jobs, numThreads);
+}
+
+static void AddWorldSlot(HavokSceneNode *node,
+                         std::unordered_map<HavokSceneNode *, size_t> &slots,
+                         std::vector<HavokSceneNode *> &order) {
+  if (slots.count(node)) {
+    return;
+  }
+
+  HavokSceneNode *parentNode = node->GetParent();
+
+  if (parentNode) {
+    AddWorldSlot(parentNode, slots, order);
+  }
+
+  slots[node] = order.size();
+  order.push_back(node);
+}
+
+void HavokImportCore::CompensateParentScale(
+    const std::vector<HavokSceneNode *> &trackNodes, size_t numFrames,
+    std::vector<AffineTM> &locals) {
+  const size_t numTracks = trackNodes.size();
+  std::unordered_map<HavokSceneNode *, size_t> slots;
+  std::vector<HavokSceneNode *> order;
+
+  for (auto n : trackNodes) {
+    if (n) {
+      AddWorldSlot(n, slots, order);
+    }
+  }
+
+  std::vector<int> slotTracks(order.size(), -1);
+
+  for (size_t t = 0; t < numTracks; t++) {
+    if (trackNodes[t]) {
+      slotTracks[slots[trackNodes[t]]] = static_cast<int>(t);
+    }
+  }
+
+  // World transforms of every involved node for every frame, [slot][frame].
+  // Parents always precede children, so a single pass is enough.
+  std::vector<AffineTM> worlds(order.size() * numFrames);
+
+  for (size_t s = 0; s < order.size(); s++) {
+    HavokSceneNode *node = order[s];
+    HavokSceneNode *parentNode = node->GetParent();
+    const AffineTM *parentWorlds =
+        parentNode ? worlds.data() + slots[parentNode] * numFrames : nullptr;
+    AffineTM *nodeWorlds = worlds.data() + s * numFrames;
+    const int curTrack = slotTracks[s];
+
+    if (curTrack < 0) {
+      // Not animated by this clip, keep its bind pose relative to parent
+      AffineTM staticLocal = node->GetWorldTM(0);
+
+      if (parentNode) {
+        staticLocal *= parentNode->GetWorldTM(0).Inverse();
+      }
+
+      for (size_t f = 0; f < numFrames; f++) {
+        nodeWorlds[f] =
+            parentWorlds ? staticLocal * parentWorlds[f] : staticLocal;
+      }
+
+      continue;
+    }
+
+    for (size_t f = 0; f < numFrames; f++) {
+      AffineTM &cMat = locals[f * numTracks + curTrack];
+
+      if (!parentWorlds) {
+        nodeWorlds[f] = cMat;
+        continue;
+      }
+
+      Vector4A16 nScale = parentWorlds[f].GetScale();
+
+      if (!nScale.X) {
+        nScale.X = FLT_EPSILON;
+      }
+
+      if (!nScale.Y) {
+        nScale.Y = FLT_EPSILON;
+      }
+
+      if (!nScale.Z) {
+        nScale.Z = FLT_EPSILON;
+      }
+
+      const Vector4A16 pos = cMat.GetTrans();
+      cMat.SetTrans(
+          Vector4A16(pos.X / nScale.X, pos.Y / nScale.Y, pos.Z / nScale.Z, 0));
+      nodeWorlds[f] = cMat * parentWorlds[f];
+    }
+  }
+}
+
+void HavokImportCore::PrepareClip(HavokImportClip &clip) {
+  ResolveTracks(clip.ani, clip.bind, clip.trackNodes);
+
+  const float frameRate = scene.GetFrameRate();
+  const size_t numFrames =
+      static_cast<size_t>(std::round(clip.ani->Duration() * frameRate));
+  clip.times.clear();
+  clip.times.reserve(numFrames + 1);
+
+  for (size_t f = 0; f <= numFrames; f++) {
+    clip.times.push_back(f / frameRate);
+  }
+}
+
+void HavokImportCore::BuildLocals(HavokImportClip &clip) {
+  const hkaAnimation *ani = clip.ani;
+  const hkaAnimatedReferenceFrame *motion = ani->GetExtractedMotion();
+  const size_t numTracks = ani->GetNumOfTransformTracks();
+  auto &trackNodes = clip.trackNodes;
+
+  // Root bones without a track still receive extracted motion,
+  // they are appended behind decoded tracks.
+  if (motion) {
+    for (auto b : boneScanner.bones) {
+      if (!b->GetParent() &&
+          std::find(trackNodes.begin(), trackNodes.end(), b) ==
+              trackNodes.end()) {
+        trackNodes.push_back(b);
+      }
+    }
+  }
+
+  const size_t numNodes = trackNodes.size();
+  const size_t numKeys = clip.times.size();
+  BlendHint blendType =
+      clip.bind ? clip.bind->GetBlendHint() : BlendHint::NORMAL;
+
+  if (additiveOverride) {
+    blendType = static_cast<BlendHint>(additiveOverride);
+  }
+
+  std::vector<AffineTM> addTMs(numTracks);
+
+  if (blendType != BlendHint::NORMAL) {
+    for (size_t curBone = 0; curBone < numTracks; curBone++) {
+      HavokSceneNode *node = trackNodes[curBone];
+
+      if (!node) {
+        continue;
+      }
+
+      AffineTM inPacket = node->GetWorldTM(0);
+      HavokSceneNode *parentNode = node->GetParent();
+
+      if (parentNode) {
+        inPacket *= parentNode->GetWorldTM(0).Inverse();
+      }
+
+      addTMs[curBone] = inPacket;
+    }
+  }
+
+  auto &locals = clip.locals;
+  locals.resize(numKeys * numNodes);
+
+  for (size_t curBone = 0; curBone < numTracks; curBone++) {
+    HavokSceneNode *node = trackNodes[curBone];
+
+    if (!node) {
+      continue;
+    }
+
+    const bool isRoot = !node->GetParent();
+    const Vector4A16 addRotation = addTMs[curBone].GetRotation();
+    const Vector4A16 addTranslation = addTMs[curBone].GetTrans();
+
+    for (size_t cFrame = 0; cFrame < numKeys; cFrame++) {
+      const hkQTransform &trans = clip.samples[cFrame * numTracks + curBone];
+      AffineTM &cMat = locals[cFrame * numNodes + curBone];
+      const Vector4A16 cTrans = trans.translation * objectScale;
+
+      if (blendType == BlendHint::ADDITIVE_DEPRECATED) {
+        cMat.SetRotate(QuatMultiply(trans.rotation, addRotation));
+        cMat.SetTrans(cTrans + addTranslation);
+      } else if (blendType == BlendHint::ADDITIVE) {
+        cMat.SetRotate(QuatMultiply(addRotation, trans.rotation));
+        cMat.SetTrans(cTrans + addTranslation);
+      } else {
+        cMat.SetRotate(trans.rotation);
+        cMat.SetTrans(cTrans);
+      }
+
+      if (!disableScale) {
+        cMat.Scale(trans.scale);
+      }
+
+      if (isRoot) {
+        cMat *= corMat;
+      }
+    }
+  }
+
+  // Clip times are relative to clip start, untracked roots are sampled
+  // where their keys are going to be placed on scene timeline.
+  const float frameRate = scene.GetFrameRate();
+
+  for (size_t curBone = numTracks; curBone < numNodes; curBone++) {
+    for (size_t cFrame = 0; cFrame < numKeys; cFrame++) {
+      locals[cFrame * numNodes + curBone] = trackNodes[curBone]->GetWorldTM(
+          (clip.startFrame + cFrame) / frameRate);
+    }
+  }
+
+  if (!disableScale) {
+    CompensateParentScale(trackNodes, numKeys, locals);
+  }
+
+  clip.samples.clear();
+  clip.samples.shrink_to_fit();
+
+  if (!motion) {
+    return;
+  }
+
+  const AffineTM inverseCorMat = corMat.Inverse();
+
+  for (size_t curBone = 0; curBone < numNodes; curBone++) {
+    HavokSceneNode *node = trackNodes[curBone];
+
+    if (!node || node->GetParent() ||
+        std::find(boneScanner.bones.begin(), boneScanner.bones.end(), node) ==
+            boneScanner.bones.end()) {
+      continue;
+    }
+
+    for (size_t cFrame = 0; cFrame < numKeys; cFrame++) {
+      hkQTransform trans;
+      motion->GetValue(trans, clip.times[cFrame]);
+
+      AffineTM cMat;
+      cMat.SetRotate(trans.rotation);
+      cMat.SetTrans(trans.translation * objectScale);
+      AffineTM &lMat = locals[cFrame * numNodes + curBone];
+      lMat = lMat * inverseCorMat * cMat * corMat;
+    }
+  }
+}
+
+void HavokImportCore::WriteKeys(const std::vector<HavokImportClip> &clips) {
+  HavokScopedTimer timer(stats, "write keys");
+  struct NodeKeys {
+    HavokSceneNode *node;
+    AffineTM restTM;
+    std::vector<float> times;
+    std::vector<AffineTM> values;
+  };
+
+  std::vector<NodeKeys> nodeKeys;
+  std::unordered_map<HavokSceneNode *, size_t> nodeSlots;
+  // Per clip: slot -> last track index animating it
+  std::vector<std::unordered_map<size_t, size_t>> clipTracks(clips.size());
+
+  for (size_t c = 0; c < clips.size(); c++) {
+    const auto &trackNodes = clips[c].trackNodes;
+
+    for (size_t t = 0; t < trackNodes.size(); t++) {
+      HavokSceneNode *node = trackNodes[t];
+
+      if (!node) {
+        continue;
+      }
+
+      auto found = nodeSlots.find(node);
+      size_t slot;
+
+      if (found == nodeSlots.end()) {
+        slot = nodeKeys.size();
+        nodeSlots[node] = slot;
+        AffineTM restTM = node->GetWorldTM(0);
+        HavokSceneNode *parentNode = node->GetParent();
+
+        if (parentNode) {
+          restTM *= parentNode->GetWorldTM(0).Inverse();
+        }
+
+        nodeKeys.push_back({node, restTM, {}, {}});
+      } else {
+        slot = found->second;
+      }
+
+      clipTracks[c][slot] = t;
+    }
+  }
+
+  const float frameRate = scene.GetFrameRate();
+
+  for (size_t c = 0; c < clips.size(); c++) {
+    const HavokImportClip &clip = clips[c];
+    const size_t numNodes = clip.trackNodes.size();
+    const size_t numKeys = clip.times.size();
+    auto keyTime = [&](size_t frame) {
+      return (clip.startFrame + frame) / frameRate;
+    };
+
+    for (size_t s = 0; s < nodeKeys.size(); s++) {
+      NodeKeys &keys = nodeKeys[s];
+      auto found = clipTracks[c].find(s);
+
+      if (found == clipTracks[c].end()) {
+        // Node is not animated by this clip, hold rest pose over its range
+        keys.times.push_back(keyTime(0));
+        keys.values.push_back(keys.restTM);
+
+        if (numKeys > 1) {
+          keys.times.push_back(keyTime(numKeys - 1));
+          keys.values.push_back(keys.restTM);
+        }
+
+        continue;
+      }
+
+      for (size_t f = 0; f < numKeys; f++) {
+        keys.times.push_back(keyTime(f));
+        keys.values.push_back(clip.locals[f * numNodes + found->second]);
+      }
+    }
+  }
+
+  for (auto &k : nodeKeys) {
+    k.node->SetLocalKeys(k.times, k.values);
+    CountStat(stats, HavokCounter::KeysWritten, k.times.size());
+  }
+}
+
+void HavokImportCore::ImportClips(std::vector<HavokImportClip> &clips) {
+  ScanScene();
+
+  const float frameRate = scene.GetFrameRate();
+  size_t startFrame = 0;
+
+  // Offsets are counted in whole frames, accumulated seconds would drift
+  // away from frame times.
+  for (auto &c : clips) {
+    PrepareClip(c);
+    c.startFrame = startFrame;
+    c.offset = startFrame / frameRate;
+    startFrame += c.times.size();
+  }
+
+  DecodeClips(clips);
+
+  {
+    HavokScopedTimer timer(stats, "build locals");
+
+    for (auto &c : clips) {
+      BuildLocals(c);
+    }
+  }
+
+  const HavokImportClip &lastClip = clips.back();
+  scene.SetAnimRange(0, (lastClip.startFrame + lastClip.times.size() - 1) /
+                           frameRate);
+  WriteKeys(clips);
+}
+
+void HavokImportCore::LoadAnimation(const hkaAnimation *ani,
+                                    const hkaAnimationBinding *bind) {
+  if (!ani) {
+    printerror("[Havok] Unregistered animation format.");
+    return;
+  }
+
+  std::vector<HavokImportClip> clips(1);
+  clips[0].ani = ani;
+  clips[0].bind = bind;
+  ImportClips(clips);
+}
+
+void HavokImportCore::LoadAnimations(const hkaAnimationContainer *aniCont,
+                                     const std::vector<size_t> &indices) {
+  std::vector<HavokImportClip> clips;
+  clips.reserve(indices.size());
+  const size_t numBindings = aniCont->GetNumBindings();
+
+  for (auto i : indices) {
+    const hkaAnimation *ani = aniCont->GetAnimation(i);
+
+    if (!ani) {
+      printerror("[Havok] Unregistered animation format, motion: " << i);
+      continue;
+    }
+
+    HavokImportClip clip;
+    clip.ani = ani;
+    clip.bind = i < numBindings ? aniCont->GetBinding(i) : nullptr;
+    clip.name = "Motion " + std::to_string(i);
+    clips.push_back(std::move(clip));
+  }
+
+  if (clips.empty()) {
+    return;
+  }
+
+  ImportClips(clips);
+  const float frameRate = scene.GetFrameRate();
+
+  for (auto &c : clips) {
+    scene.AddClipMarker(c.name, c.offset,
+                        (c.startFrame + c.times.size() - 1) / frameRate);
+  }
+}
+
+void ParseMotionList(const std::string &list, size_t numAnimations,
+                     std::vector<size_t> &indices) {
+  indices.clear();
+  size_t cPos = 0;
+
+  while (cPos < list.size()) {
+    size_t nextPos = list.find(',', cPos);
+
+    if (nextPos == list.npos) {
+      nextPos = list.size();
+    }
+
+    const std::string item = list.substr(cPos, nextPos - cPos);
+    cPos = nextPos + 1;
+
+    if (item.find_first_not_of(" \t") == item.npos) {
+      continue;
+    }
+
+    const size_t dashPos = item.find('-');
+    char *endPtr = nullptr;
+    const unsigned long first = std::strtoul(item.c_str(), &endPtr, 10);
+    unsigned long last = first;
+    bool valid = endPtr != item.c_str();
+
+    if (valid && dashPos != item.npos) {
+      const char *lastStr = item.c_str() + dashPos + 1;
+      last = std::strtoul(lastStr, &endPtr, 10);
+      valid = endPtr != lastStr && last >= first;
+    }
+
+    if (!valid || last >= numAnimations) {
+      printwarning("[Havok] Invalid motion list item: " << item);
+      continue;
+    }
+
+    for (size_t i = first; i <= last; i++) {
+      indices.push_back(i);
+    }
+  }
+
+  if (list.find_first_not_of(" \t") == list.npos) {
+    for (size_t i = 0; i < numAnimations; i++) {
+      indices.push_back(i);
+    }
+  }
+}
@@ -0,0 +1,212 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#include "HavokMath.h"
+#include <cmath>
+
+static float RowLength(const float *row) {
+  return std::sqrt(row[0] * row[0] + row[1] * row[1] + row[2] * row[2]);
+}
+
+void AffineTM::IdentityMatrix() {
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 3; c++) {
+      m[r][c] = r == c ? 1.0f : 0.0f;
+    }
+  }
+}
+
+void AffineTM::Translate(const Vector4A16 &value) {
+  m[3][0] += value.X;
+  m[3][1] += value.Y;
+  m[3][2] += value.Z;
+}
+
+void AffineTM::SetRotate(const Vector4A16 &quat) {
+  const float x = quat.X, y = quat.Y, z = quat.Z, w = quat.W;
+
+  // Transposed rotation matrix, rows are rotated basis vectors
+  m[0][0] = 1.0f - 2.0f * (y * y + z * z);
+  m[0][1] = 2.0f * (x * y + w * z);
+  m[0][2] = 2.0f * (x * z - w * y);
+  m[1][0] = 2.0f * (x * y - w * z);
+  m[1][1] = 1.0f - 2.0f * (x * x + z * z);
+  m[1][2] = 2.0f * (y * z + w * x);
+  m[2][0] = 2.0f * (x * z + w * y);
+  m[2][1] = 2.0f * (y * z - w * x);
+  m[2][2] = 1.0f - 2.0f * (x * x + y * y);
+}
+
+Vector4A16 AffineTM::GetRotation() const {
+  AffineTM nMat = *this;
+  nMat.NoScale();
+  const auto &n = nMat.m;
+  const float trace = n[0][0] + n[1][1] + n[2][2];
+
+  if (trace > 0.0f) {
+    const float s = 0.5f / std::sqrt(trace + 1.0f);
+    return Vector4A16((n[1][2] - n[2][1]) * s, (n[2][0] - n[0][2]) * s,
+                      (n[0][1] - n[1][0]) * s, 0.25f / s);
+  } else if (n[0][0] > n[1][1] && n[0][0] > n[2][2]) {
+    const float s = 2.0f * std::sqrt(1.0f + n[0][0] - n[1][1] - n[2][2]);
+    return Vector4A16(0.25f * s, (n[1][0] + n[0][1]) / s,
+                      (n[2][0] + n[0][2]) / s, (n[1][2] - n[2][1]) / s);
+  } else if (n[1][1] > n[2][2]) {
+    const float s = 2.0f * std::sqrt(1.0f + n[1][1] - n[0][0] - n[2][2]);
+    return Vector4A16((n[1][0] + n[0][1]) / s, 0.25f * s,
+                      (n[2][1] + n[1][2]) / s, (n[2][0] - n[0][2]) / s);
+  }
+
+  const float s = 2.0f * std::sqrt(1.0f + n[2][2] - n[0][0] - n[1][1]);
+  return Vector4A16((n[2][0] + n[0][2]) / s, (n[2][1] + n[1][2]) / s,
+                    0.25f * s, (n[0][1] - n[1][0]) / s);
+}
+
+Vector4A16 AffineTM::GetScale() const {
+  return Vector4A16(RowLength(m[0]), RowLength(m[1]), RowLength(m[2]), 0.0f);
+}
+
+void AffineTM::Scale(const Vector4A16 &value) {
+  for (int r = 0; r < 3; r++) {
+    m[r][0] *= value.X;
+    m[r][1] *= value.Y;
+    m[r][2] *= value.Z;
+  }
+}
+
+void AffineTM::NoScale() {
+  for (int r = 0; r < 3; r++) {
+    const float len = RowLength(m[r]);
+
+    if (len > 0.0f) {
+      for (int c = 0; c < 3; c++) {
+        m[r][c] /= len;
+      }
+    }
+  }
+}
+
+AffineTM AffineTM::Inverse() const {
+  AffineTM retVal;
+  auto &i = retVal.m;
+  const float det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                    m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                    m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+
+  if (det == 0.0f) {
+    return retVal;
+  }
+
+  const float iDet = 1.0f / det;
+
+  i[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * iDet;
+  i[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * iDet;
+  i[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * iDet;
+  i[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * iDet;
+  i[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * iDet;
+  i[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * iDet;
+  i[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * iDet;
+  i[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * iDet;
+  i[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * iDet;
+
+  for (int c = 0; c < 3; c++) {
+    i[3][c] = -(m[3][0] * i[0][c] + m[3][1] * i[1][c] + m[3][2] * i[2][c]);
+  }
+
+  return retVal;
+}
+
+AffineTM AffineTM::operator*(const AffineTM &other) const {
+  AffineTM retVal;
+  const auto &o = other.m;
+
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 3; c++) {
+      retVal.m[r][c] =
+          m[r][0] * o[0][c] + m[r][1] * o[1][c] + m[r][2] * o[2][c];
+    }
+  }
+
+  for (int c = 0; c < 3; c++) {
+    retVal.m[3][c] += o[3][c];
+  }
+
+  return retVal;
+}
+
+void ParseCorrectionMatrix(AffineTM &value, const std::string &text) {
+  float sign = 1.0f;
+  int curRow = 0;
+
+  for (auto t : text) {
+    if (curRow > 2) {
+      return;
+    }
+
+    switch (t) {
+    case '-':
+      sign = -1.f;
+      continue;
+    case 'X':
+      value.SetRow(curRow, Vector4A16(sign, 0.0f, 0.0f, 0.0f));
+      break;
+    case 'Y':
+      value.SetRow(curRow, Vector4A16(0.0f, sign, 0.0f, 0.0f));
+      break;
+    case 'Z':
+      value.SetRow(curRow, Vector4A16(0.0f, 0.0f, sign, 0.0f));
+      break;
+    }
+
+    curRow++;
+    sign = 1.f;
+  }
+}
+
+Vector4A16 QuatMultiply(const Vector4A16 &q0, const Vector4A16 &q1) {
+  return Vector4A16(q0.W * q1.X + q0.X * q1.W + q0.Y * q1.Z - q0.Z * q1.Y,
+                    q0.W * q1.Y - q0.X * q1.Z + q0.Y * q1.W + q0.Z * q1.X,
+                    q0.W * q1.Z + q0.X * q1.Y - q0.Y * q1.X + q0.Z * q1.W,
+                    q0.W * q1.W - q0.X * q1.X - q0.Y * q1.Y - q0.Z * q1.Z);
+}
+
+void MakeQuatsContinuous(Vector4A16 *quats, size_t numQuats,
+                         size_t stride) {
+  for (size_t q = 0; q < numQuats; q++) {
+    Vector4A16 &cQuat = quats[q * stride];
+    const float len = std::sqrt(cQuat.X * cQuat.X + cQuat.Y * cQuat.Y +
+                                cQuat.Z * cQuat.Z + cQuat.W * cQuat.W);
+
+    if (len > 0.0f) {
+      cQuat = cQuat * (1.0f / len);
+    }
+
+    if (!q) {
+      continue;
+    }
+
+    const Vector4A16 &prev = quats[(q - 1) * stride];
+    const float dot = prev.X * cQuat.X + prev.Y * cQuat.Y + prev.Z * cQuat.Z +
+                      prev.W * cQuat.W;
+
+    if (dot < 0.0f) {
+      cQuat = cQuat * -1.0f;
+    }
+  }
+}
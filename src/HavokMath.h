@@ -0,0 +1,79 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#pragma once
+#include "hklib/hk_base.hpp"
+#include <string>
+
+// Affine transform matrix with the same layout and conventions as 3ds max's
+// Matrix3: row vectors, rows 0-2 are axes, row 3 is translation.
+// Rotations are Havok quaternions (no conjugation needed on either side).
+class AffineTM {
+public:
+  float m[4][3];
+
+  AffineTM() { IdentityMatrix(); }
+
+  void IdentityMatrix();
+
+  Vector4A16 GetRow(int row) const {
+    return Vector4A16(m[row][0], m[row][1], m[row][2], 0.0f);
+  }
+
+  void SetRow(int row, const Vector4A16 &value) {
+    m[row][0] = value.X;
+    m[row][1] = value.Y;
+    m[row][2] = value.Z;
+  }
+
+  Vector4A16 GetTrans() const { return GetRow(3); }
+  void SetTrans(const Vector4A16 &value) { SetRow(3, value); }
+  void Translate(const Vector4A16 &value);
+
+  // Sets rotation axes from Havok quaternion, translation is kept
+  void SetRotate(const Vector4A16 &quat);
+  // Returns Havok quaternion of normalized axes
+  Vector4A16 GetRotation() const;
+  // Returns lengths of axes
+  Vector4A16 GetScale() const;
+  // Same as Matrix3::Scale, multiplies columns of axes
+  void Scale(const Vector4A16 &value);
+  // Same as Matrix3::NoScale, normalizes axes
+  void NoScale();
+
+  AffineTM Inverse() const;
+  AffineTM operator*(const AffineTM &other) const;
+  AffineTM &operator*=(const AffineTM &other) {
+    *this = *this * other;
+    return *this;
+  }
+};
+
+// Sets axes from preset correction matrix text, for example "X-ZY".
+// Every axis is optionally prefixed by minus sign.
+void ParseCorrectionMatrix(AffineTM &value, const std::string &text);
+
+// Hamilton product of Havok quaternions
+Vector4A16 QuatMultiply(const Vector4A16 &q0, const Vector4A16 &q1);
+// Normalizes quaternions and flips each one into hemisphere of its
+// predecessor, so interpolation between neighbours takes the shortest path.
+// Stride is distance between quaternions in Vector4A16 units, it allows
+// processing rotations stored inside of transform arrays.
+void MakeQuatsContinuous(Vector4A16 *quats, size_t numQuats,
+                         size_t stride = 1);
@@ -17,12 +17,18 @@
     Havok Tool uses HavokLib 2016-2020 Lukas Cone
 */
 #include "datas/directory_scanner.hpp"
+#include "datas/master_printer.hpp"
 #include "datas/pugiex.hpp"
 #include "datas/reflector_xml.hpp"
 #include <map>
+#include <sstream>
+#include <unordered_map>
 
+#include "HavokFileCache.h"
 #include "HavokMax.h"
+#include "HavokStats.h"
 #include "MAXex/hk_preset.hpp"
+#include "MaxScene.h"
 #define max(a, b) (((a) > (b)) ? (a) : (b))
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 #include "resource.h"
@@ -44,7 +50,9 @@ const TCHAR _homePage[] =
 
 REFLECTOR_CREATE(HavokMax, 1, VARNAMES, checked, visible, motionIndex, toolset,
                  animationStart, animationEnd, captureFrame, currentPresetName,
-                 additiveOverride);
+                 additiveOverride, numThreads, motionList, cacheBudget,
+                 positionTolerance, rotationTolerance, scaleTolerance,
+                 clipList, traceFile);
 
 struct PresetData : ReflectorInterface<PresetData> {
   float scale;
@@ -55,7 +63,6 @@ struct PresetData : ReflectorInterface<PresetData> {
 
 REFLECTOR_CREATE(PresetData, 1, VARNAMES, scale);
 
-std::set<TSTRING> extensions = {_T("hkx"), _T("hkt"), _T("hka")};
 static std::map<std::string, PresetData> presets{
     {"Default", PresetData{}},
 };
@@ -77,37 +84,16 @@ void SavePresets(pugi::xml_node node) {
 }
 
 static void GetCorrectionMatrix(Matrix3 &value, es::string_view text) {
-  float sign = 1.0f;
-  uint32 curRow = 0;
-
-  for (auto t : text) {
-    if (curRow > 2) {
-      return;
-    }
-
-    switch (t) {
-    case '-':
-      sign = -1.f;
-      continue;
-    case 'X':
-      value.SetRow(curRow, Point3(sign, 0.0f, 0.0f));
-      break;
-    case 'Y':
-      value.SetRow(curRow, Point3(0.0f, sign, 0.0f));
-      break;
-    case 'Z':
-      value.SetRow(curRow, Point3(0.0f, 0.0f, sign));
-      break;
-    }
-
-    curRow++;
-    sign = 1.f;
-  }
+  AffineTM corMat = ToAffineTM(value);
+  ParseCorrectionMatrix(corMat, text.to_string());
+  value = ToMatrix3(corMat);
 }
 
-static auto &LoadPreset(pugi::xml_node node) {
+typedef std::map<std::string, PresetData> PresetMap;
+
+static auto &LoadPreset(pugi::xml_node node, PresetMap &destPresets) {
   auto prName = node.attribute("name").value();
-  auto &prData = presets[prName];
+  auto &prData = destPresets[prName];
   ReflectorWrap<PresetData> rWrap(prData);
   ReflectorXMLUtil::Load(rWrap, node);
   auto corMatNode = node.child("matrix");
@@ -128,11 +114,20 @@ static void LoadPresets(pugi::xml_node node) {
   }
 
   for (auto ch : rootNode) {
-    LoadPreset(ch);
+    LoadPreset(ch, presets);
   }
 }
 
-static void LoadExternalPresetLegacy(const TCHAR *filename) {
+// External preset file parsed during this session
+struct PresetFile {
+  size_t size = 0;
+  time_t modified = 0;
+  PresetMap presets;
+  std::vector<TSTRING> extensions;
+};
+
+static void LoadExternalPresetLegacy(const TCHAR *filename,
+                                     PresetFile &prFile) {
   TSTRING prName_;
   prName_.resize(0x102);
   TCHAR legacyGroup[] = _T("HK_PRESET");
@@ -147,7 +142,7 @@ static void LoadExternalPresetLegacy(const TCHAR *filename) {
 
   decltype(auto) prName = std::to_string(prName_);
   prName.erase(0, 2);
-  auto &prData = presets[prName];
+  auto &prData = prFile.presets[prName];
   prData.external = true;
   prName_.resize(16);
 
@@ -182,18 +177,18 @@ static void LoadExternalPresetLegacy(const TCHAR *filename) {
     }
 
     if (found == extRef.npos) {
-      extensions.emplace(extRef);
+      prFile.extensions.emplace_back(extRef);
       break;
     } else {
       es::basic_string_view<TCHAR> subitem(extRef.begin(), found);
-      extensions.emplace(subitem);
+      prFile.extensions.emplace_back(subitem);
       extRef.remove_prefix(found + 1);
     }
   }
 }
 
-void LoadExternalPreset(pugi::xml_node node) {
-  auto &prData = LoadPreset(node);
+static void LoadExternalPreset(pugi::xml_node node, PresetFile &prFile) {
+  auto &prData = LoadPreset(node, prFile.presets);
   prData.external = true;
   auto extNode = node.child("extensions");
 
@@ -202,40 +197,167 @@ void LoadExternalPreset(pugi::xml_node node) {
   }
 
   for (auto c : extNode) {
-    extensions.emplace(ToTSTRING(c.name()));
+    prFile.extensions.emplace_back(ToTSTRING(c.name()));
+  }
+}
+
+static void LoadExternalPreset(const std::string &path, PresetFile &prFile) {
+  try {
+    pugi::xml_document doc = XMLFromFile(path);
+    auto prNode = doc.child("HavokPreset");
+
+    if (!prNode.empty()) {
+      LoadExternalPreset(prNode, prFile);
+    }
+  } catch (...) {
   }
 }
 
+static bool IsLegacyPreset(const std::string &path) {
+  return path.size() > 4 && !path.compare(path.size() - 4, 4, ".ini");
+}
+
+// Parsed preset files are kept for whole session and keyed by path,
+// a file is parsed again only when its size or modification time changes.
+static std::map<std::string, PresetFile> presetFiles;
+static bool presetFilesApplied = false;
+
 void ScanPresets() {
   TSTRING cfgPath = IPathConfigMgr::GetPathConfigMgr()->GetDir(APP_PLUGCFG_DIR);
   auto cfgPathS = std::to_string(cfgPath);
-  DirectoryScanner legacyScan;
-  legacyScan.AddFilter(".ini");
-  legacyScan.Scan(cfgPathS);
+  std::vector<std::string> files;
+
+  for (auto filter : {".ini", ".xml"}) {
+    DirectoryScanner scanner;
+    scanner.AddFilter(filter);
+    scanner.Scan(cfgPathS);
+    files.insert(files.end(), scanner.begin(), scanner.end());
+  }
+
+  std::map<std::string, PresetFile> scannedFiles;
+  size_t numParsed = 0;
+
+  for (auto &s : files) {
+    size_t fileSize;
+    time_t modified;
+
+    if (!GetFileStamp(s, fileSize, modified)) {
+      continue;
+    }
+
+    auto found = presetFiles.find(s);
+
+    if (found != presetFiles.end() && found->second.size == fileSize &&
+        found->second.modified == modified) {
+      scannedFiles[s] = std::move(found->second);
+      presetFiles.erase(found);
+      continue;
+    }
+
+    PresetFile &prFile = scannedFiles[s];
+    prFile.size = fileSize;
+    prFile.modified = modified;
+    numParsed++;
 
-  for (auto &s : legacyScan) {
-    auto cName = ToTSTRING(s);
-    LoadExternalPresetLegacy(cName.data());
+    if (IsLegacyPreset(s)) {
+      auto cName = ToTSTRING(s);
+      LoadExternalPresetLegacy(cName.data(), prFile);
+    } else {
+      LoadExternalPreset(s, prFile);
+    }
   }
 
-  DirectoryScanner scanner;
-  scanner.AddFilter(".xml");
-  scanner.Scan(cfgPathS);
+  // Only changed or removed files are left over
+  std::map<std::string, PresetFile> staleFiles;
+  staleFiles.swap(presetFiles);
+  presetFiles.swap(scannedFiles);
+
+  if (presetFilesApplied && !numParsed && staleFiles.empty()) {
+    return;
+  }
 
-  for (auto &s : scanner) {
-    try {
-      pugi::xml_document doc = XMLFromFile(s);
-      auto prNode = doc.child("HavokPreset");
+  for (auto &f : staleFiles) {
+    for (auto &p : f.second.presets) {
+      auto found = presets.find(p.first);
+
+      if (found != presets.end() && found->second.external) {
+        presets.erase(found);
+      }
+    }
+  }
 
-      if (prNode.empty()) {
+  // Xml presets take precedence over legacy ones
+  for (bool legacyPass : {true, false}) {
+    for (auto &f : presetFiles) {
+      if (IsLegacyPreset(f.first) != legacyPass) {
         continue;
       }
 
-      LoadExternalPreset(prNode);
-    } catch (...) {
-      continue;
+      for (auto &p : f.second.presets) {
+        presets[p.first] = p.second;
+      }
     }
   }
+
+  presetFilesApplied = true;
+}
+
+static std::vector<HavokExtension> extensionTable;
+static std::unordered_map<TSTRING, size_t> extensionIndex;
+
+static TSTRING NormalizeExtension(const TSTRING &extension) {
+  const size_t extBegin = extension.find_first_not_of(_T('.'));
+
+  if (extBegin == extension.npos) {
+    return TSTRING();
+  }
+
+  TSTRING retVal = extension.substr(extBegin);
+
+  for (auto &c : retVal) {
+    c = static_cast<TCHAR>(_totlower(c));
+  }
+
+  return retVal;
+}
+
+static void AddExtension(const TSTRING &extension,
+                         const std::string &presetName) {
+  TSTRING normalized = NormalizeExtension(extension);
+
+  if (normalized.empty() || extensionIndex.count(normalized)) {
+    return;
+  }
+
+  extensionIndex[normalized] = extensionTable.size();
+  extensionTable.push_back({std::move(normalized), presetName});
+}
+
+void BuildExtensionTable() {
+  ScanPresets();
+  extensionTable.clear();
+  extensionIndex.clear();
+
+  for (auto e : {_T("hkx"), _T("hkt"), _T("hka")}) {
+    AddExtension(e, "");
+  }
+
+  // Same precedence as presets, xml presets are preferred over legacy ones
+  for (bool legacyPass : {false, true}) {
+    for (auto &f : presetFiles) {
+      if (IsLegacyPreset(f.first) != legacyPass || f.second.presets.empty()) {
+        continue;
+      }
+
+      for (auto &e : f.second.extensions) {
+        AddExtension(e, f.second.presets.begin()->first);
+      }
+    }
+  }
+}
+
+const std::vector<HavokExtension> &GetExtensionTable() {
+  return extensionTable;
 }
 
 static HBITMAP bitmapGreen, bitmapRed, bitmapGray;
@@ -271,7 +393,9 @@ void DestroyHavokResources() {
 HavokMax::HavokMax()
     : hWnd(), comboHandle(), currentPresetName("Default"), objectScale(1.0f),
       instanceDialogType(DLGTYPE_unknown), toolset(HK500), captureFrame(),
-      motionIndex(), additiveOverride() {
+      motionIndex(), additiveOverride(), numThreads(), cacheBudget(256),
+      positionTolerance(0.001f), rotationTolerance(0.1f),
+      scaleTolerance(0.001f) {
   corMat.IdentityMatrix();
 
   Interval aniRange = GetCOREInterface()->GetAnimRange();
@@ -283,12 +407,49 @@ HavokMax::HavokMax()
 
   ScanPresets();
   LoadCFG();
+  SelectPreset(currentPresetName);
+}
+
+bool HavokMax::SelectPreset(const std::string &presetName) {
+  auto fndPres = presets.find(presetName);
+
+  if (es::IsEnd(presets, fndPres)) {
+    return false;
+  }
+
+  currentPresetName = presetName;
+  corMat = fndPres->second.corMat;
+  objectScale = fndPres->second.scale;
+  return true;
+}
+
+void HavokMax::UseExtensionPreset(const TSTRING &fileName) {
+  extensionPreset.clear();
+  const size_t dotPos = fileName.find_last_of(_T('.'));
+
+  if (dotPos == fileName.npos) {
+    return;
+  }
 
-  auto fndPres = presets.find(currentPresetName);
+  const TSTRING extension = NormalizeExtension(fileName.substr(dotPos));
+  auto found = extensionIndex.find(extension);
 
-  if (!es::IsEnd(presets, fndPres)) {
-    corMat = fndPres->second.corMat;
-    objectScale = fndPres->second.scale;
+  if (found == extensionIndex.end()) {
+    return;
+  }
+
+  const std::string &presetName = extensionTable[found->second].presetName;
+
+  if (!presetName.empty() && SelectPreset(presetName)) {
+    extensionPreset = presetName;
+  }
+}
+
+void HavokMax::ReportStats(const HavokStats &stats, const char *title) {
+  stats.PrintSummary(title);
+
+  if (!traceFile.empty()) {
+    stats.WriteTrace(traceFile);
   }
 }
 
@@ -351,24 +512,83 @@ static void LoadLegacyConfig() {
   }
 }
 
-void HavokMax::LoadCFG() {
-  pugi::xml_document doc;
-  auto conf = GetConfig();
+// Config document shared by all plugin instances. File is read again only
+// when its stamp changes and written only when serialized content differs.
+static pugi::xml_document residentConfig;
+static std::string residentConfigText;
+static size_t residentConfigSize = 0;
+static time_t residentConfigModified = 0;
+static bool residentConfigValid = false;
+
+static std::string SerializeConfig(const pugi::xml_document &doc) {
+  std::ostringstream str;
+  doc.save(str);
+  return str.str();
+}
+
+static void StampResidentConfig() {
+  const std::string conf = std::to_string(GetConfig());
+
+  if (!GetFileStamp(conf, residentConfigSize, residentConfigModified)) {
+    residentConfigSize = 0;
+    residentConfigModified = 0;
+  }
+}
 
-  if (doc.load_file(conf.data())) {
+static bool LoadResidentConfig() {
+  const auto conf = GetConfig();
+  size_t fileSize;
+  time_t modified;
+
+  if (!GetFileStamp(std::to_string(conf), fileSize, modified)) {
+    return residentConfigValid;
+  }
+
+  if (residentConfigValid && fileSize == residentConfigSize &&
+      modified == residentConfigModified) {
+    return true;
+  }
+
+  residentConfigValid = !!residentConfig.load_file(conf.data());
+  residentConfigText =
+      residentConfigValid ? SerializeConfig(residentConfig) : std::string();
+  residentConfigSize = fileSize;
+  residentConfigModified = modified;
+  return residentConfigValid;
+}
+
+void HavokMax::LoadCFG() {
+  if (LoadResidentConfig()) {
     ReflectorWrap<HavokMax> rWrap(this);
-    ReflectorXMLUtil::Load(rWrap, doc);
-    LoadPresets(doc);
+    ReflectorXMLUtil::Load(rWrap, residentConfig);
+    LoadPresets(residentConfig);
   } else {
     LoadLegacyConfig();
   }
 
+  // Not stored by older versions, derived from animation checkbox
+  visible.Set(Visible::CH_ANICOMPRESS, checked[Checked::CH_ANIMATION]);
+  visible.Set(Visible::CH_EXPORT_CLIPS, checked[Checked::CH_ANIMATION]);
+
   // clang-format off
   CheckDlgButton(hWnd, IDC_CH_ANIMATION, checked[Checked::CH_ANIMATION]);
   CheckDlgButton(hWnd, IDC_CH_ANIOPTIMIZE, checked[Checked::CH_ANIOPTIMIZE]);
+  CheckDlgButton(hWnd, IDC_CH_ANICOMPRESS, checked[Checked::CH_ANICOMPRESS]);
   CheckDlgButton(hWnd, IDC_CH_ANISKELETON, checked[Checked::CH_ANISKELETON]);
   CheckDlgButton(hWnd, IDC_CH_DISABLE_SCALE, checked[Checked::CH_DISABLE_SCALE]);
+  CheckDlgButton(hWnd, IDC_CH_ALL_MOTIONS, checked[Checked::CH_ALL_MOTIONS]);
+  EnableWindow(GetDlgItem(hWnd, IDC_EDIT_MOTIONLIST), checked[Checked::CH_ALL_MOTIONS]);
+  EnableWindow(GetDlgItem(hWnd, IDC_EDIT_MOTIONID), !checked[Checked::CH_ALL_MOTIONS]);
+  EnableWindow(GetDlgItem(hWnd, IDC_SPIN_MOTIONID), !checked[Checked::CH_ALL_MOTIONS]);
+  SetDlgItemText(hWnd, IDC_EDIT_MOTIONLIST, ToTSTRING(motionList).data());
   EnableWindow(GetDlgItem(hWnd, IDC_CH_ANIOPTIMIZE), visible[Visible::CH_ANIOPTIMIZE]);
+  EnableWindow(GetDlgItem(hWnd, IDC_CH_ANICOMPRESS), visible[Visible::CH_ANICOMPRESS]);
+  CheckDlgButton(hWnd, IDC_CH_EXPORT_CLIPS, checked[Checked::CH_EXPORT_CLIPS]);
+  CheckDlgButton(hWnd, IDC_CH_SEPARATE_CLIPS, checked[Checked::CH_SEPARATE_CLIPS]);
+  SetDlgItemText(hWnd, IDC_EDIT_CLIPLIST, ToTSTRING(clipList).data());
+  EnableWindow(GetDlgItem(hWnd, IDC_CH_EXPORT_CLIPS), visible[Visible::CH_EXPORT_CLIPS]);
+  EnableWindow(GetDlgItem(hWnd, IDC_EDIT_CLIPLIST), visible[Visible::CH_EXPORT_CLIPS] && checked[Checked::CH_EXPORT_CLIPS]);
+  EnableWindow(GetDlgItem(hWnd, IDC_CH_SEPARATE_CLIPS), visible[Visible::CH_EXPORT_CLIPS] && checked[Checked::CH_EXPORT_CLIPS]);
   EnableWindow(GetDlgItem(hWnd, IDC_CH_ANISKELETON), visible[Visible::CH_ANISKELETON]);
   EnableWindow(GetDlgItem(hWnd, IDC_EDIT_ANIEND), visible[Visible::SP_ANIEND]);
   EnableWindow(GetDlgItem(hWnd, IDC_SPIN_ANIEND), visible[Visible::SP_ANIEND]);
@@ -382,8 +602,29 @@ void HavokMax::SaveCFG() {
   ReflectorWrap<HavokMax> rWrap(this);
   ReflectorXMLUtil::Save(rWrap, doc);
   SavePresets(doc);
-  auto conf = GetConfig();
-  doc.save_file(conf.data());
+  std::string docText = SerializeConfig(doc);
+
+  if (residentConfigValid && docText == residentConfigText) {
+    return;
+  }
+
+  // Settings are replaced in a single step, so an interrupted write
+  // cannot leave a truncated file behind.
+  const auto conf = GetConfig();
+  const TSTRING tempConf = conf + _T(".tmp");
+
+  if (!doc.save_file(tempConf.data()) ||
+      !MoveFileEx(tempConf.data(), conf.data(),
+                  MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+    printerror("[Havok] Cannot write config: " << std::to_string(conf));
+    DeleteFile(tempConf.data());
+    return;
+  }
+
+  residentConfig.reset(doc);
+  residentConfigText = std::move(docText);
+  residentConfigValid = true;
+  StampResidentConfig();
 }
 
 int HavokMax::SavePreset(const std::string &presetName) {
@@ -501,6 +742,11 @@ INT_PTR CALLBACK DialogCallbacksMain(HWND hWnd, UINT message, WPARAM wParam,
     imp->Setup(hWnd);
     imp->LoadCFG();
 
+    // Config holds last used preset, extension preset takes precedence
+    if (!imp->extensionPreset.empty()) {
+      imp->SelectPreset(imp->extensionPreset);
+    }
+
     for (auto &p : presets) {
       auto cName = ToTSTRING(p.first);
       SendMessage(imp->comboHandle, CB_ADDSTRING, 0, (LPARAM)cName.data());
@@ -618,8 +864,16 @@ INT_PTR CALLBACK DialogCallbacksMain(HWND hWnd, UINT message, WPARAM wParam,
       imp->visible.Set(Visible::CH_ANISKELETON, isChecked);
       imp->visible.Set(Visible::SP_ANIEND, isChecked);
       imp->visible.Set(Visible::SP_ANISTART, isChecked);
+      imp->visible.Set(Visible::CH_ANICOMPRESS, isChecked);
+      imp->visible.Set(Visible::CH_EXPORT_CLIPS, isChecked);
 
       EnableWindow(GetDlgItem(hWnd, IDC_CH_ANISKELETON), isChecked);
+      EnableWindow(GetDlgItem(hWnd, IDC_CH_ANICOMPRESS), isChecked);
+      EnableWindow(GetDlgItem(hWnd, IDC_CH_EXPORT_CLIPS), isChecked);
+      EnableWindow(GetDlgItem(hWnd, IDC_EDIT_CLIPLIST),
+                   isChecked && imp->checked[Checked::CH_EXPORT_CLIPS]);
+      EnableWindow(GetDlgItem(hWnd, IDC_CH_SEPARATE_CLIPS),
+                   isChecked && imp->checked[Checked::CH_EXPORT_CLIPS]);
       EnableWindow(GetDlgItem(hWnd, IDC_EDIT_ANIEND), isChecked);
       EnableWindow(GetDlgItem(hWnd, IDC_EDIT_ANISTART), isChecked);
       EnableWindow(GetDlgItem(hWnd, IDC_SPIN_ANIEND), isChecked);
@@ -641,11 +895,60 @@ INT_PTR CALLBACK DialogCallbacksMain(HWND hWnd, UINT message, WPARAM wParam,
                        IsDlgButtonChecked(hWnd, IDC_CH_ANIOPTIMIZE) != 0);
       break;
 
+    case IDC_CH_ANICOMPRESS:
+      imp->checked.Set(Checked::CH_ANICOMPRESS,
+                       IsDlgButtonChecked(hWnd, IDC_CH_ANICOMPRESS) != 0);
+      break;
+
     case IDC_CH_DISABLE_SCALE:
       imp->checked.Set(Checked::CH_DISABLE_SCALE,
                        IsDlgButtonChecked(hWnd, IDC_CH_DISABLE_SCALE) != 0);
       break;
 
+    case IDC_CH_ALL_MOTIONS: {
+      const bool isChecked = IsDlgButtonChecked(hWnd, IDC_CH_ALL_MOTIONS) != 0;
+      imp->checked.Set(Checked::CH_ALL_MOTIONS, isChecked);
+      EnableWindow(GetDlgItem(hWnd, IDC_EDIT_MOTIONLIST), isChecked);
+      EnableWindow(GetDlgItem(hWnd, IDC_EDIT_MOTIONID), !isChecked);
+      EnableWindow(GetDlgItem(hWnd, IDC_SPIN_MOTIONID), !isChecked);
+      break;
+    }
+
+    case IDC_CH_EXPORT_CLIPS: {
+      const bool isChecked = IsDlgButtonChecked(hWnd, IDC_CH_EXPORT_CLIPS) != 0;
+      imp->checked.Set(Checked::CH_EXPORT_CLIPS, isChecked);
+      EnableWindow(GetDlgItem(hWnd, IDC_EDIT_CLIPLIST), isChecked);
+      EnableWindow(GetDlgItem(hWnd, IDC_CH_SEPARATE_CLIPS), isChecked);
+      break;
+    }
+
+    case IDC_CH_SEPARATE_CLIPS:
+      imp->checked.Set(Checked::CH_SEPARATE_CLIPS,
+                       IsDlgButtonChecked(hWnd, IDC_CH_SEPARATE_CLIPS) != 0);
+      break;
+
+    case IDC_EDIT_CLIPLIST:
+      if (HIWORD(wParam) == EN_CHANGE) {
+        HWND editHandle = reinterpret_cast<HWND>(lParam);
+        const int textLen = GetWindowTextLength(editHandle);
+        TSTRING wndText;
+        wndText.resize(textLen);
+        GetWindowText(editHandle, &wndText[0], textLen + 1);
+        imp->clipList = std::to_string(wndText);
+      }
+      break;
+
+    case IDC_EDIT_MOTIONLIST:
+      if (HIWORD(wParam) == EN_CHANGE) {
+        HWND editHandle = reinterpret_cast<HWND>(lParam);
+        const int textLen = GetWindowTextLength(editHandle);
+        TSTRING wndText;
+        wndText.resize(textLen);
+        GetWindowText(editHandle, &wndText[0], textLen + 1);
+        imp->motionList = std::to_string(wndText);
+      }
+      break;
+
     default:
       return imp ? imp->DlgCommandCallBack(wParam, lParam) : FALSE;
     }
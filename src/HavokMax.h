@@ -42,12 +42,14 @@ static constexpr int HAVOKMAX_VERSIONINT =
     HavokMax_VERSION_MAJOR * 100 + HavokMax_VERSION_MINOR;
 
 struct PresetData;
+class HavokStats;
 extern HINSTANCE hInstance;
 
 REFLECTOR_CREATE(Checked, ENUM, 2, CLASS, 8, CH_ANIMATION, CH_ANISKELETON,
-                 CH_ANIOPTIMIZE, CH_DISABLE_SCALE);
+                 CH_ANIOPTIMIZE, CH_DISABLE_SCALE, CH_ALL_MOTIONS,
+                 CH_ANICOMPRESS, CH_EXPORT_CLIPS, CH_SEPARATE_CLIPS);
 REFLECTOR_CREATE(Visible, ENUM, 2, CLASS, 8, CH_ANISKELETON, CH_ANIOPTIMIZE,
-                 SP_ANIEND, SP_ANISTART);
+                 SP_ANIEND, SP_ANISTART, CH_ANICOMPRESS, CH_EXPORT_CLIPS);
 
 class HavokMax : public ReflectorInterface<HavokMax> {
 public:
@@ -57,9 +59,22 @@ public:
   es::Flags<Checked> checked;
   es::Flags<Visible> visible;
   int32 motionIndex, additiveOverride;
+  int32 numThreads;
+  // Parsed file cache budget in MB, 0 = disabled
+  int32 cacheBudget;
+  // Track compression tolerances, rotation in degrees
+  float positionTolerance, rotationTolerance, scaleTolerance;
   hkToolset toolset;
   TimeValue animationStart, animationEnd, captureFrame;
   std::string currentPresetName;
+  // Preset registered for extension of processed file, applied over
+  // preset loaded from config, not saved
+  std::string extensionPreset;
+  std::string motionList;
+  // Named export ranges, scene clip markers are used when empty
+  std::string clipList;
+  // Chrome trace of last import/export, disabled when empty
+  std::string traceFile;
 
   // preset data
   float objectScale;
@@ -76,6 +91,12 @@ public:
   void SaveCFG();
   void UpdateData();
   void SetupExportUI();
+  // Applies preset data, returns false for unknown preset
+  bool SelectPreset(const std::string &presetName);
+  // Selects preset, that registered extension of given file
+  void UseExtensionPreset(const TSTRING &fileName);
+  // Prints stage timings and counters, writes trace when enabled
+  void ReportStats(const HavokStats &stats, const char *title);
 
   int SavePreset(const std::string &presetName);
   virtual int SavePreset(PresetData &presetData) = 0;
@@ -121,4 +142,14 @@ public:
 void BuildHavokResources();
 void DestroyHavokResources();
 void ShowAboutDLG(HWND hWnd);
-extern std::set<TSTRING> extensions;
+struct HavokExtension {
+  // Lower case, without leading dot
+  TSTRING extension;
+  // Preset, that registered extension, empty for built-in extensions
+  std::string presetName;
+};
+
+// Scans presets and builds deduplicated extension table,
+// called once from LibInitialize.
+void BuildExtensionTable();
+const std::vector<HavokExtension> &GetExtensionTable();
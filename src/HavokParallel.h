@@ -0,0 +1,108 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline size_t GetNumWorkers(size_t requested, size_t numItems) {
+  size_t numWorkers = requested;
+
+  if (!numWorkers) {
+    numWorkers = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+
+  return std::max<size_t>(std::min(numWorkers, numItems), 1);
+}
+
+// HavokLib uses shared class registries and static buffers, so parsing and
+// writing of packfiles is not known to be reentrant. Worker threads must
+// hold this lock around IhkPackFile::Create and xmlHavokFile::ToXML.
+inline std::mutex &HavokLibMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Calls func(index) for every index in [0, numItems) across worker threads.
+// Items are handed out in blocks of grainSize consecutive indices.
+// First exception thrown by any worker is rethrown on calling thread.
+template <class F>
+void ParallelFor(size_t numItems, size_t numThreads, F &&func,
+                 size_t grainSize = 1) {
+  const size_t numWorkers = GetNumWorkers(numThreads, numItems);
+
+  if (numWorkers < 2) {
+    for (size_t i = 0; i < numItems; i++) {
+      func(i);
+    }
+
+    return;
+  }
+
+  std::atomic<size_t> nextItem(0);
+  std::exception_ptr error;
+  std::mutex errorMutex;
+
+  auto worker = [&]() {
+    try {
+      for (;;) {
+        const size_t begin = nextItem.fetch_add(grainSize);
+
+        if (begin >= numItems) {
+          break;
+        }
+
+        const size_t end = std::min(begin + grainSize, numItems);
+
+        for (size_t i = begin; i < end; i++) {
+          func(i);
+        }
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(errorMutex);
+
+      if (!error) {
+        error = std::current_exception();
+      }
+
+      nextItem = numItems;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(numWorkers - 1);
+
+  for (size_t w = 1; w < numWorkers; w++) {
+    workers.emplace_back(worker);
+  }
+
+  worker();
+
+  for (auto &w : workers) {
+    w.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
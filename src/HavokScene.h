@@ -0,0 +1,64 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#pragma once
+#include "HavokMath.h"
+#include <string>
+#include <vector>
+
+// All times are in seconds.
+struct HavokClipMarker {
+  std::string name;
+  float start;
+  float end;
+};
+
+class HavokSceneNode {
+public:
+  virtual std::string GetName() const = 0;
+  virtual void SetName(const std::string &name) = 0;
+  // Returns nullptr, when node is parented to scene root
+  virtual HavokSceneNode *GetParent() = 0;
+  virtual void AttachChild(HavokSceneNode *child) = 0;
+  virtual bool IsSelected() const = 0;
+  virtual bool GetUserProp(const std::string &key, std::string &value) const = 0;
+  virtual void SetUserProp(const std::string &key, const std::string &value) = 0;
+  virtual AffineTM GetWorldTM(float time) = 0;
+  virtual void SetWorldTM(float time, const AffineTM &value) = 0;
+  // Replaces all animation keys of node, values are relative to parent node.
+  // Keys outside of given times are removed.
+  virtual void SetLocalKeys(const std::vector<float> &times,
+                            const std::vector<AffineTM> &values) = 0;
+  virtual ~HavokSceneNode() = default;
+};
+
+class HavokScene {
+public:
+  virtual HavokSceneNode *CreateBone() = 0;
+  // Collects all nodes, parents are always before their children
+  virtual void EnumNodes(std::vector<HavokSceneNode *> &nodes) = 0;
+  virtual float GetFrameRate() const = 0;
+  virtual void SetAnimRange(float start, float end) = 0;
+  // Marks named animation range on timeline, replaces marker of the same name
+  virtual void AddClipMarker(const std::string &name, float start,
+                             float end) = 0;
+  // Collects named animation ranges marked on timeline, names are unique
+  virtual void GetClipMarkers(std::vector<HavokClipMarker> &markers) = 0;
+  virtual ~HavokScene() = default;
+};
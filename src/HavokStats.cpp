@@ -0,0 +1,242 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#include "HavokStats.h"
+#include "datas/master_printer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+static const char *counterNames[] = {
+    "scanned nodes",
+    "name resolves",
+    "unresolved names",
+    "unresolved bone indices",
+    "decoded samples",
+    "keys written",
+    "GetNodeTM calls",
+    "bytes written",
+};
+
+static_assert(sizeof(counterNames) / sizeof(*counterNames) ==
+                  static_cast<size_t>(HavokCounter::Count),
+              "Counter names mismatch");
+
+static double ToMilliseconds(HavokStats::Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+HavokStats::HavokStats() : origin(Clock::now()) {
+  for (auto &c : counters) {
+    c = 0;
+  }
+}
+
+size_t HavokStats::ThreadIndex() {
+  const auto threadID = std::this_thread::get_id();
+  auto found = std::find(threads.begin(), threads.end(), threadID);
+  const size_t thread = std::distance(threads.begin(), found);
+
+  if (found == threads.end()) {
+    threads.push_back(threadID);
+  }
+
+  return thread;
+}
+
+void HavokStats::AddStage(const char *name, Clock::time_point start,
+                          Clock::time_point end) {
+  std::lock_guard<std::mutex> lock(stageMutex);
+  stages.push_back({name, start, end, ThreadIndex()});
+}
+
+void HavokStats::AddRecord(const char *category, const std::string &name,
+                           const RecordValues &values) {
+  const Clock::time_point time = Clock::now();
+  std::lock_guard<std::mutex> lock(stageMutex);
+  records.push_back({category, name, values, time, ThreadIndex()});
+}
+
+std::string EscapeJSON(const std::string &text) {
+  std::string retVal;
+
+  for (char c : text) {
+    switch (c) {
+    case '"':
+      retVal += "\\\"";
+      break;
+    case '\\':
+      retVal += "\\\\";
+      break;
+    case '\n':
+      retVal += "\\n";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char code[8];
+        snprintf(code, sizeof(code), "\\u%04x", c);
+        retVal += code;
+      } else {
+        retVal += c;
+      }
+    }
+  }
+
+  return retVal;
+}
+
+void HavokStats::PrintSummary(const char *title) const {
+  struct StageSum {
+    std::string name;
+    Clock::duration duration;
+    size_t numCalls;
+  };
+
+  std::vector<Stage> sorted;
+
+  {
+    std::lock_guard<std::mutex> lock(stageMutex);
+    sorted = stages;
+  }
+
+  // Stages are recorded once finished, list them in order they started
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Stage &s0, const Stage &s1) {
+                     return s0.start < s1.start;
+                   });
+
+  std::vector<StageSum> sums;
+
+  for (auto &s : sorted) {
+    auto found =
+        std::find_if(sums.begin(), sums.end(),
+                     [&](const StageSum &sum) { return sum.name == s.name; });
+
+    if (found == sums.end()) {
+      sums.push_back({s.name, s.end - s.start, 1});
+    } else {
+      found->duration += s.end - s.start;
+      found->numCalls++;
+    }
+  }
+
+  std::string stageList;
+  char buffer[128];
+
+  for (auto &s : sums) {
+    snprintf(buffer, sizeof(buffer), "%s%s %.1f ms",
+             stageList.empty() ? "" : ", ", s.name.c_str(),
+             ToMilliseconds(s.duration));
+    stageList += buffer;
+
+    if (s.numCalls > 1) {
+      stageList += " (" + std::to_string(s.numCalls) + "x)";
+    }
+  }
+
+  std::string counterList;
+
+  for (size_t c = 0; c < static_cast<size_t>(HavokCounter::Count); c++) {
+    if (counters[c]) {
+      counterList += (counterList.empty() ? "" : ", ") +
+                     std::string(counterNames[c]) + ": " +
+                     std::to_string(counters[c]);
+    }
+  }
+
+  snprintf(buffer, sizeof(buffer), "%.1f ms",
+           ToMilliseconds(Clock::now() - origin));
+  printinfo("[Havok] " << title << " " << buffer << ": " << stageList);
+
+  if (!counterList.empty()) {
+    printinfo("[Havok] " << counterList);
+  }
+}
+
+bool HavokStats::WriteTrace(const std::string &path) const {
+#ifdef _WIN32
+  // Paths are UTF-8, narrow ofstream would open them in ANSI codepage
+  std::ofstream str;
+  const int pathLen = MultiByteToWideChar(
+      CP_UTF8, 0, path.data(), static_cast<int>(path.size()), nullptr, 0);
+
+  if (pathLen) {
+    std::wstring widePath(pathLen, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.data(), static_cast<int>(path.size()),
+                        &widePath[0], pathLen);
+    str.open(widePath.c_str());
+  }
+#else
+  std::ofstream str(path);
+#endif
+
+  if (!str.is_open()) {
+    printerror("[Havok] Cannot create trace file: " << path);
+    return false;
+  }
+
+  auto toMicroseconds = [&](Clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - origin)
+        .count();
+  };
+
+  str << "{\"traceEvents\":[";
+  std::lock_guard<std::mutex> lock(stageMutex);
+  Clock::time_point lastEnd = origin;
+
+  for (auto &s : stages) {
+    str << "\n{\"name\":\"" << s.name
+        << "\",\"cat\":\"havok\",\"ph\":\"X\",\"pid\":1,\"tid\":" << s.thread
+        << ",\"ts\":" << toMicroseconds(s.start)
+        << ",\"dur\":" << toMicroseconds(s.end) - toMicroseconds(s.start)
+        << "},";
+    lastEnd = std::max(lastEnd, s.end);
+  }
+
+  for (auto &r : records) {
+    str << "\n{\"name\":\"" << EscapeJSON(r.name) << "\",\"cat\":\""
+        << r.category << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":"
+        << r.thread << ",\"ts\":" << toMicroseconds(r.time) << ",\"args\":{";
+
+    for (size_t v = 0; v < r.values.size(); v++) {
+      str << (v ? "," : "") << '"' << r.values[v].first
+          << "\":" << r.values[v].second;
+    }
+
+    str << "}},";
+  }
+
+  str << "\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":"
+      << toMicroseconds(lastEnd) << ",\"args\":{";
+
+  for (size_t c = 0; c < static_cast<size_t>(HavokCounter::Count); c++) {
+    str << (c ? "," : "") << '"' << counterNames[c] << "\":" << counters[c];
+  }
+
+  str << "}}\n],\"displayTimeUnit\":\"ms\"}\n";
+
+  return true;
+}
@@ -0,0 +1,121 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+enum class HavokCounter {
+  ScannedNodes,
+  NameResolves,
+  NameMisses,
+  BoneIndexMisses,
+  DecodedSamples,
+  KeysWritten,
+  WorldTMCalls,
+  BytesWritten,
+  Count,
+};
+
+// Stage timings and counters of a single import or export.
+// Can be updated from worker threads.
+class HavokStats {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  HavokStats();
+
+  void Add(HavokCounter counter, size_t value) {
+    counters[static_cast<size_t>(counter)] += value;
+  }
+  size_t Get(HavokCounter counter) const {
+    return counters[static_cast<size_t>(counter)];
+  }
+  void AddStage(const char *name, Clock::time_point start,
+                Clock::time_point end);
+  typedef std::vector<std::pair<const char *, double>> RecordValues;
+  // Named values, written only into trace as instant event
+  void AddRecord(const char *category, const std::string &name,
+                 const RecordValues &values);
+  // Prints summed time of every stage and non zero counters
+  void PrintSummary(const char *title) const;
+  // Writes stages as Chrome trace events, viewable in chrome://tracing
+  bool WriteTrace(const std::string &path) const;
+
+private:
+  struct Stage {
+    const char *name;
+    Clock::time_point start;
+    Clock::time_point end;
+    size_t thread;
+  };
+
+  struct Record {
+    const char *category;
+    std::string name;
+    RecordValues values;
+    Clock::time_point time;
+    size_t thread;
+  };
+
+  // Requires locked stageMutex
+  size_t ThreadIndex();
+
+  Clock::time_point origin;
+  std::atomic<size_t> counters[static_cast<size_t>(HavokCounter::Count)];
+  mutable std::mutex stageMutex;
+  std::vector<Stage> stages;
+  std::vector<Record> records;
+  std::vector<std::thread::id> threads;
+};
+
+// Records enclosing scope as stage, does nothing without stats
+class HavokScopedTimer {
+public:
+  HavokScopedTimer(HavokStats *stats_, const char *name_)
+      : stats(stats_), name(name_) {
+    if (stats) {
+      start = HavokStats::Clock::now();
+    }
+  }
+  ~HavokScopedTimer() {
+    if (stats) {
+      stats->AddStage(name, start, HavokStats::Clock::now());
+    }
+  }
+
+private:
+  HavokStats *stats;
+  const char *name;
+  HavokStats::Clock::time_point start;
+};
+
+// Escapes string value for JSON output
+std::string EscapeJSON(const std::string &text);
+
+inline void CountStat(HavokStats *stats, HavokCounter counter, size_t value) {
+  if (stats) {
+    stats->Add(counter, value);
+  }
+}
@@ -0,0 +1,365 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#include "HavokTracks.h"
+#include "HavokParallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+static const float radToDeg = 57.2957795f;
+
+static float Dot(const Vector4A16 &v0, const Vector4A16 &v1) {
+  return v0.X * v1.X + v0.Y * v1.Y + v0.Z * v1.Z + v0.W * v1.W;
+}
+
+static float Distance3(const Vector4A16 &v0, const Vector4A16 &v1) {
+  const Vector4A16 diff = v0 - v1;
+  return std::sqrt(diff.X * diff.X + diff.Y * diff.Y + diff.Z * diff.Z);
+}
+
+static Vector4A16 Lerp(const Vector4A16 &v0, const Vector4A16 &v1,
+                       float delta) {
+  return v0 + (v1 - v0) * delta;
+}
+
+hkQTransform SampleTrack(const HavokTrack &track, float frame) {
+  const size_t lastFrame = track.size() - 1;
+  frame = std::min(std::max(frame, 0.0f), static_cast<float>(lastFrame));
+  const size_t frame0 = static_cast<size_t>(frame);
+  const float delta = frame - frame0;
+
+  if (frame0 >= lastFrame || delta <= 0.0f) {
+    return track[std::min(frame0, lastFrame)];
+  }
+
+  const hkQTransform &tm0 = track[frame0];
+  const hkQTransform &tm1 = track[frame0 + 1];
+  hkQTransform retVal;
+  retVal.translation = Lerp(tm0.translation, tm1.translation, delta);
+  retVal.scale = Lerp(tm0.scale, tm1.scale, delta);
+
+  const Vector4A16 rot1 =
+      Dot(tm0.rotation, tm1.rotation) < 0.0f ? tm1.rotation * -1.0f
+                                             : tm1.rotation;
+  Vector4A16 rotation = Lerp(tm0.rotation, rot1, delta);
+  const float len = std::sqrt(Dot(rotation, rotation));
+
+  if (len > 0.0f) {
+    rotation = rotation * (1.0f / len);
+  }
+
+  retVal.rotation = rotation;
+
+  return retVal;
+}
+
+void ResampleTrack(const HavokTrack &track, size_t numFrames,
+                   HavokTrack &outTrack) {
+  outTrack.resize(numFrames);
+
+  if (numFrames < 2) {
+    if (numFrames) {
+      outTrack[0] = track[0];
+    }
+
+    return;
+  }
+
+  const float frameStep =
+      static_cast<float>(track.size() - 1) / (numFrames - 1);
+
+  for (size_t f = 0; f < numFrames; f++) {
+    outTrack[f] = SampleTrack(track, f * frameStep);
+  }
+}
+
+HavokTrackError MeasureTrackError(const HavokTrack &source,
+                                  const HavokTrack &resampled) {
+  HavokTrackError retVal;
+
+  if (source.size() < 2) {
+    return retVal;
+  }
+
+  const float frameStep =
+      static_cast<float>(resampled.size() - 1) / (source.size() - 1);
+
+  for (size_t f = 0; f < source.size(); f++) {
+    const hkQTransform &sTM = source[f];
+    const hkQTransform rTM = SampleTrack(resampled, f * frameStep);
+    const float rotDot =
+        std::min(std::fabs(Dot(sTM.rotation, rTM.rotation)), 1.0f);
+
+    retVal.position = std::max(retVal.position,
+                               Distance3(sTM.translation, rTM.translation));
+    retVal.rotation =
+        std::max(retVal.rotation, 2.0f * std::acos(rotDot) * radToDeg);
+    retVal.scale = std::max(retVal.scale, Distance3(sTM.scale, rTM.scale));
+  }
+
+  return retVal;
+}
+
+size_t FindCompressedFrameCount(const std::vector<HavokTrack *> &tracks,
+                                const std::vector<HavokTrack *> &sources,
+                                const HavokTrackTolerance &tolerance,
+                                size_t numThreads) {
+  if (tracks.empty()) {
+    return 0;
+  }
+
+  const size_t numFrames = tracks[0]->size();
+
+  auto IsValid = [&](size_t numOutFrames) {
+    std::atomic<bool> valid(true);
+
+    ParallelFor(tracks.size(), numThreads, [&](size_t t) {
+      if (!valid) {
+        return;
+      }
+
+      HavokTrack resampled;
+      ResampleTrack(*tracks[t], numOutFrames, resampled);
+
+      if (!MeasureTrackError(*sources[t], resampled).Within(tolerance)) {
+        valid = false;
+      }
+    });
+
+    return static_cast<bool>(valid);
+  };
+
+  // Error is not strictly monotonic in frame count, so this may miss
+  // a lower valid count, returned count is always a validated one.
+  size_t low = 2, high = numFrames;
+
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+
+    if (IsValid(mid)) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+
+  return high;
+}
+
+bool HavokTrackChannels::IsStatic() const {
+  for (int c = 0; c < 3; c++) {
+    if (translation[c] != HavokChannelType::Static ||
+        scale[c] != HavokChannelType::Static) {
+      return false;
+    }
+  }
+
+  return rotation == HavokChannelType::Static;
+}
+
+bool HavokTrackChannels::HasConstant() const {
+  for (int c = 0; c < 3; c++) {
+    if (translation[c] == HavokChannelType::Constant ||
+        scale[c] == HavokChannelType::Constant) {
+      return true;
+    }
+  }
+
+  return rotation == HavokChannelType::Constant;
+}
+
+void HavokChannelStats::Add(const HavokTrackChannels &channels) {
+  auto AddChannel = [&](HavokChannelType type) {
+    switch (type) {
+    case HavokChannelType::Static:
+      numStatic++;
+      break;
+    case HavokChannelType::Constant:
+      numConstant++;
+      break;
+    default:
+      numAnimated++;
+      break;
+    }
+  };
+
+  for (int c = 0; c < 3; c++) {
+    AddChannel(channels.translation[c]);
+    AddChannel(channels.scale[c]);
+  }
+
+  AddChannel(channels.rotation);
+}
+
+static float &Component(Vector4A16 &value, int index) {
+  return index == 0 ? value.X : index == 1 ? value.Y : value.Z;
+}
+
+static float Component(const Vector4A16 &value, int index) {
+  return index == 0 ? value.X : index == 1 ? value.Y : value.Z;
+}
+
+// Position and scale tolerances apply to whole vector, so components are
+// classified together. Vector is static, when every frame stays within
+// tolerance from reference. Otherwise components with small range become
+// constant, as long as their combined flattening error stays within
+// tolerance, components with largest range are left animated first.
+static void ClassifyVector(float refDistance, const float (&ranges)[3],
+                           float tolerance,
+                           HavokChannelType (&outTypes)[3]) {
+  if (refDistance <= tolerance) {
+    std::fill(std::begin(outTypes), std::end(outTypes),
+              HavokChannelType::Static);
+    return;
+  }
+
+  int order[3] = {0, 1, 2};
+  std::sort(std::begin(order), std::end(order),
+            [&](int c0, int c1) { return ranges[c0] < ranges[c1]; });
+  float sqError = 0.0f;
+
+  for (int c : order) {
+    const float halfRange = ranges[c] * 0.5f;
+    const float cSqError = sqError + halfRange * halfRange;
+
+    if (cSqError <= tolerance * tolerance) {
+      outTypes[c] = HavokChannelType::Constant;
+      sqError = cSqError;
+    } else {
+      outTypes[c] = HavokChannelType::Animated;
+    }
+  }
+}
+
+HavokTrackChannels ClassifyTrack(const HavokTrack &track,
+                                 const hkQTransform &reference,
+                                 const HavokTrackTolerance &tolerance) {
+  HavokTrackChannels retVal;
+
+  if (track.empty()) {
+    std::fill(std::begin(retVal.translation), std::end(retVal.translation),
+              HavokChannelType::Static);
+    std::fill(std::begin(retVal.scale), std::end(retVal.scale),
+              HavokChannelType::Static);
+    retVal.rotation = HavokChannelType::Static;
+    return retVal;
+  }
+
+  float minValues[2][3], maxValues[2][3];
+  float refDistances[2] = {};
+  float rotRefDeviation = 0.0f, rotFirstDeviation = 0.0f;
+
+  for (int c = 0; c < 3; c++) {
+    minValues[0][c] = maxValues[0][c] = Component(track[0].translation, c);
+    minValues[1][c] = maxValues[1][c] = Component(track[0].scale, c);
+  }
+
+  for (auto &f : track) {
+    const Vector4A16 *values[2] = {&f.translation, &f.scale};
+    const Vector4A16 *refValues[2] = {&reference.translation,
+                                      &reference.scale};
+
+    for (int v = 0; v < 2; v++) {
+      for (int c = 0; c < 3; c++) {
+        const float cValue = Component(*values[v], c);
+        minValues[v][c] = std::min(minValues[v][c], cValue);
+        maxValues[v][c] = std::max(maxValues[v][c], cValue);
+      }
+
+      refDistances[v] =
+          std::max(refDistances[v], Distance3(*values[v], *refValues[v]));
+    }
+
+    const float refDot =
+        std::min(std::fabs(Dot(f.rotation, reference.rotation)), 1.0f);
+    const float firstDot =
+        std::min(std::fabs(Dot(f.rotation, track[0].rotation)), 1.0f);
+    rotRefDeviation = std::max(rotRefDeviation, std::acos(refDot));
+    rotFirstDeviation = std::max(rotFirstDeviation, std::acos(firstDot));
+  }
+
+  float ranges[2][3];
+
+  for (int v = 0; v < 2; v++) {
+    for (int c = 0; c < 3; c++) {
+      ranges[v][c] = maxValues[v][c] - minValues[v][c];
+    }
+  }
+
+  ClassifyVector(refDistances[0], ranges[0], tolerance.position,
+                 retVal.translation);
+  ClassifyVector(refDistances[1], ranges[1], tolerance.scale, retVal.scale);
+
+  // Angle between quaternions is twice the angle of their 4D vectors,
+  // range of rotation is measured against first frame, not middle value.
+  const float rotRefAngle = 2.0f * rotRefDeviation * radToDeg;
+  const float rotRange = 4.0f * rotFirstDeviation * radToDeg;
+
+  if (rotRefAngle <= tolerance.rotation) {
+    retVal.rotation = HavokChannelType::Static;
+  } else {
+    retVal.rotation = rotRange * 0.5f <= tolerance.rotation
+                          ? HavokChannelType::Constant
+                          : HavokChannelType::Animated;
+  }
+
+  return retVal;
+}
+
+void FlattenConstantChannels(HavokTrack &track,
+                             const HavokTrackChannels &channels) {
+  for (int c = 0; c < 3; c++) {
+    if (channels.translation[c] == HavokChannelType::Constant) {
+      float minValue = Component(track[0].translation, c);
+      float maxValue = minValue;
+
+      for (auto &f : track) {
+        minValue = std::min(minValue, Component(f.translation, c));
+        maxValue = std::max(maxValue, Component(f.translation, c));
+      }
+
+      for (auto &f : track) {
+        Component(f.translation, c) = (minValue + maxValue) * 0.5f;
+      }
+    }
+
+    if (channels.scale[c] == HavokChannelType::Constant) {
+      float minValue = Component(track[0].scale, c);
+      float maxValue = minValue;
+
+      for (auto &f : track) {
+        minValue = std::min(minValue, Component(f.scale, c));
+        maxValue = std::max(maxValue, Component(f.scale, c));
+      }
+
+      for (auto &f : track) {
+        Component(f.scale, c) = (minValue + maxValue) * 0.5f;
+      }
+    }
+  }
+
+  if (channels.rotation == HavokChannelType::Constant) {
+    const Vector4A16 rotation = track[0].rotation;
+
+    for (auto &f : track) {
+      f.rotation = rotation;
+    }
+  }
+}
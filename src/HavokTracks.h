@@ -0,0 +1,95 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#pragma once
+#include "havok_api.hpp"
+#include <vector>
+
+typedef std::vector<hkQTransform> HavokTrack;
+
+// Rotation values are in degrees
+struct HavokTrackTolerance {
+  float position = 0.001f;
+  float rotation = 0.1f;
+  float scale = 0.001f;
+};
+
+struct HavokTrackError {
+  float position = 0.0f;
+  float rotation = 0.0f;
+  float scale = 0.0f;
+
+  bool Within(const HavokTrackTolerance &tolerance) const {
+    return position <= tolerance.position && rotation <= tolerance.rotation &&
+           scale <= tolerance.scale;
+  }
+};
+
+// Samples track at fractional frame, interpolates same way as Havok runtime
+// does for interleaved animations (lerp, normalized quaternion lerp).
+hkQTransform SampleTrack(const HavokTrack &track, float frame);
+// Uniformly resamples track over same duration into numFrames frames
+void ResampleTrack(const HavokTrack &track, size_t numFrames,
+                   HavokTrack &outTrack);
+// Largest difference between every source frame and its reconstruction
+// from resampled track
+HavokTrackError MeasureTrackError(const HavokTrack &source,
+                                  const HavokTrack &resampled);
+// Finds lowest common frame count, that reconstructs all tracks within
+// tolerance. Resampled tracks[t] is measured against sources[t], so error
+// of earlier reduction passes is included. Tracks are evaluated on worker
+// threads.
+size_t FindCompressedFrameCount(const std::vector<HavokTrack *> &tracks,
+                                const std::vector<HavokTrack *> &sources,
+                                const HavokTrackTolerance &tolerance,
+                                size_t numThreads);
+
+enum class HavokChannelType {
+  Static,   // Matches reference pose
+  Constant, // Doesn't change over time, but differs from reference pose
+  Animated,
+};
+
+// Classification of track components
+struct HavokTrackChannels {
+  HavokChannelType translation[3];
+  HavokChannelType rotation;
+  HavokChannelType scale[3];
+
+  bool IsStatic() const;
+  bool HasConstant() const;
+};
+
+struct HavokChannelStats {
+  size_t numStatic = 0;
+  size_t numConstant = 0;
+  size_t numAnimated = 0;
+
+  void Add(const HavokTrackChannels &channels);
+};
+
+// Classifies every component in a single pass over track. Removing static
+// track or flattening constant channels keeps distance of whole position
+// and scale vectors within tolerance.
+HavokTrackChannels ClassifyTrack(const HavokTrack &track,
+                                 const hkQTransform &reference,
+                                 const HavokTrackTolerance &tolerance);
+// Replaces values of constant channels with their middle value
+void FlattenConstantChannels(HavokTrack &track,
+                             const HavokTrackChannels &channels);
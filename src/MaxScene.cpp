@@ -0,0 +1,314 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#include "MaxScene.h"
+#include <cmath>
+#include <decomp.h>
+
+TimeValue ToTicks(float time) {
+  return static_cast<TimeValue>(std::lround(time * TIME_TICKSPERSEC));
+}
+
+AffineTM ToAffineTM(const Matrix3 &mat) {
+  AffineTM retVal;
+
+  for (int r = 0; r < 4; r++) {
+    const Point3 row = mat.GetRow(r);
+    retVal.m[r][0] = row.x;
+    retVal.m[r][1] = row.y;
+    retVal.m[r][2] = row.z;
+  }
+
+  return retVal;
+}
+
+Matrix3 ToMatrix3(const AffineTM &mat) {
+  auto &m = mat.m;
+  return Matrix3(Point3(m[0][0], m[0][1], m[0][2]),
+                 Point3(m[1][0], m[1][1], m[1][2]),
+                 Point3(m[2][0], m[2][1], m[2][2]),
+                 Point3(m[3][0], m[3][1], m[3][2]));
+}
+
+std::string MaxSceneNode::GetName() const {
+  return std::to_string(node->GetName());
+}
+
+void MaxSceneNode::SetName(const std::string &name) {
+  TSTRING boneName = ToTSTRING(name);
+  node->SetName(ToBoneName(boneName));
+}
+
+HavokSceneNode *MaxSceneNode::GetParent() {
+  INode *parentNode = node->GetParentNode();
+
+  if (!parentNode || parentNode->IsRootNode()) {
+    return nullptr;
+  }
+
+  return scene.Wrap(parentNode);
+}
+
+void MaxSceneNode::AttachChild(HavokSceneNode *child) {
+  node->AttachChild(static_cast<MaxSceneNode *>(child)->node);
+}
+
+bool MaxSceneNode::GetUserProp(const std::string &key,
+                               std::string &value) const {
+  const MSTR propName = ToTSTRING(key).data();
+
+  if (!node->UserPropExists(propName)) {
+    return false;
+  }
+
+  MSTR propValue;
+  node->GetUserPropString(propName, propValue);
+  value = std::to_string(propValue.data());
+  return true;
+}
+
+void MaxSceneNode::SetUserProp(const std::string &key,
+                               const std::string &value) {
+  node->SetUserPropString(ToTSTRING(key).data(), ToTSTRING(value).data());
+}
+
+AffineTM MaxSceneNode::GetWorldTM(float time) {
+  CountStat(scene.stats, HavokCounter::WorldTMCalls, 1);
+  return ToAffineTM(node->GetNodeTM(ToTicks(time)));
+}
+
+void MaxSceneNode::SetWorldTM(float time, const AffineTM &value) {
+  node->SetNodeTM(ToTicks(time), ToMatrix3(value));
+}
+
+void MaxSceneNode::SetLocalKeys(const std::vector<float> &times,
+                                const std::vector<AffineTM> &values) {
+  Control *cnt = node->GetTMController();
+
+  if (cnt->GetPositionController()->ClassID() !=
+      Class_ID(LININTERP_POSITION_CLASS_ID, 0)) {
+    cnt->SetPositionController((Control *)CreateInstance(
+        CTRL_POSITION_CLASS_ID, Class_ID(LININTERP_POSITION_CLASS_ID, 0)));
+  }
+
+  if (cnt->GetRotationController()->ClassID() !=
+      Class_ID(LININTERP_ROTATION_CLASS_ID, 0)) {
+    cnt->SetRotationController((Control *)CreateInstance(
+        CTRL_ROTATION_CLASS_ID, Class_ID(LININTERP_ROTATION_CLASS_ID, 0)));
+  }
+
+  if (cnt->GetScaleController()->ClassID() !=
+      Class_ID(LININTERP_SCALE_CLASS_ID, 0)) {
+    cnt->SetScaleController((Control *)CreateInstance(
+        CTRL_SCALE_CLASS_ID, Class_ID(LININTERP_SCALE_CLASS_ID, 0)));
+  }
+
+  const int numKeys = static_cast<int>(times.size());
+  std::vector<ILinPoint3Key> posKeys(numKeys);
+  std::vector<ILinRotKey> rotKeys(numKeys);
+  std::vector<ILinScaleKey> scaleKeys(numKeys);
+
+  for (int k = 0; k < numKeys; k++) {
+    AffineParts parts;
+    decomp_affine(ToMatrix3(values[k]), &parts);
+    const TimeValue cTime = ToTicks(times[k]);
+
+    posKeys[k].time = cTime;
+    posKeys[k].flags = 0;
+    posKeys[k].val = parts.t;
+
+    rotKeys[k].time = cTime;
+    rotKeys[k].flags = 0;
+    rotKeys[k].val = parts.q;
+
+    scaleKeys[k].time = cTime;
+    scaleKeys[k].flags = 0;
+    scaleKeys[k].val = ScaleValue(parts.k * parts.f, parts.u);
+  }
+
+  // Former hybrid -> linear controller copy, done on key values instead
+  std::vector<Vector4A16> rotations(numKeys);
+
+  for (int k = 0; k < numKeys; k++) {
+    const Quat &cQuat = rotKeys[k].val;
+    rotations[k] = Vector4A16(cQuat.x, cQuat.y, cQuat.z, cQuat.w);
+  }
+
+  MakeQuatsContinuous(rotations.data(), rotations.size());
+
+  for (int k = 0; k < numKeys; k++) {
+    const Vector4A16 &cQuat = rotations[k];
+    rotKeys[k].val = Quat(cQuat.X, cQuat.Y, cQuat.Z, cQuat.W);
+  }
+
+  auto SetKeys = [numKeys](Control *ctrl, auto &keys) {
+    IKeyControl *kCon = GetKeyControlInterface(ctrl);
+    kCon->SetNumKeys(numKeys);
+
+    for (int k = 0; k < numKeys; k++) {
+      kCon->SetKey(k, &keys[k]);
+    }
+
+    ctrl->NotifyDependents(FOREVER, PART_ALL, REFMSG_CHANGE);
+  };
+
+  SetKeys(cnt->GetPositionController(), posKeys);
+  SetKeys(cnt->GetRotationController(), rotKeys);
+  SetKeys(cnt->GetScaleController(), scaleKeys);
+}
+
+MaxSceneNode *MaxScene::Wrap(INode *node) {
+  auto &wrapped = nodes[node];
+
+  if (!wrapped) {
+    wrapped.reset(new MaxSceneNode(node, *this));
+  }
+
+  return wrapped.get();
+}
+
+HavokSceneNode *MaxScene::CreateBone() {
+  Object *obj = static_cast<Object *>(
+      CreateInstance(HELPER_CLASS_ID, Class_ID(DUMMY_CLASS_ID, 0)));
+  INode *node = GetCOREInterface()->CreateObjectNode(obj);
+  node->ShowBone(2);
+  node->SetWireColor(0x80ff);
+
+  return Wrap(node);
+}
+
+static class : public ITreeEnumProc {
+public:
+  MaxScene *scene;
+  std::vector<HavokSceneNode *> *nodes;
+
+  int callback(INode *node) override {
+    nodes->push_back(scene->Wrap(node));
+    return TREE_CONTINUE;
+  }
+} iSceneScanner;
+
+void MaxScene::EnumNodes(std::vector<HavokSceneNode *> &outNodes) {
+  iSceneScanner.scene = this;
+  iSceneScanner.nodes = &outNodes;
+  GetCOREInterface7()->GetScene()->EnumTree(&iSceneScanner);
+}
+
+float MaxScene::GetFrameRate() const {
+  return static_cast<float>(::GetFrameRate());
+}
+
+void MaxScene::SetAnimRange(float start, float end) {
+  GetCOREInterface()->SetAnimRange(Interval(ToTicks(start), ToTicks(end)));
+}
+
+// Markers are kept in first default note track of scene root
+static DefNoteTrack *FindClipNoteTrack(INode *rootNode) {
+  for (int n = 0; n < rootNode->NumNoteTracks(); n++) {
+    NoteTrack *cTrack = rootNode->GetNoteTrack(n);
+
+    if (cTrack->ClassID() == Class_ID(NOTETRACK_CLASS_ID, 0)) {
+      return static_cast<DefNoteTrack *>(cTrack);
+    }
+  }
+
+  return nullptr;
+}
+
+void MaxScene::AddClipMarker(const std::string &name, float start,
+                             float end) {
+  if (!noteTrack) {
+    INode *rootNode = GetCOREInterface()->GetRootNode();
+    noteTrack = FindClipNoteTrack(rootNode);
+
+    if (!noteTrack) {
+      noteTrack = static_cast<DefNoteTrack *>(NewDefaultNoteTrack());
+      rootNode->AddNoteTrack(noteTrack);
+    }
+  }
+
+  const TSTRING startNote = ToTSTRING(name);
+  const TSTRING endNote = ToTSTRING(name + " end");
+  NoteKeyTab &trackKeys = noteTrack->keys;
+
+  // Marker of the same name from previous import is replaced
+  for (int k = trackKeys.Count() - 1; k >= 0; k--) {
+    const TSTRING note = trackKeys[k]->note.data();
+
+    if (note == startNote || note == endNote) {
+      delete trackKeys[k];
+      trackKeys.Delete(k, 1);
+    }
+  }
+
+  NoteKey *keys[] = {new NoteKey(ToTicks(start), startNote.data()),
+                     new NoteKey(ToTicks(end), endNote.data())};
+  trackKeys.Append(2, keys);
+}
+
+void MaxScene::GetClipMarkers(std::vector<HavokClipMarker> &markers) {
+  static const std::string endSuffix = " end";
+  INode *rootNode = GetCOREInterface()->GetRootNode();
+  // Names are unique, later marker replaces earlier one
+  std::unordered_map<std::string, size_t> markerIndex;
+
+  for (int n = 0; n < rootNode->NumNoteTracks(); n++) {
+    NoteTrack *cTrack = rootNode->GetNoteTrack(n);
+
+    if (cTrack->ClassID() != Class_ID(NOTETRACK_CLASS_ID, 0)) {
+      continue;
+    }
+
+    DefNoteTrack *track = static_cast<DefNoteTrack *>(cTrack);
+    std::unordered_map<std::string, float> openClips;
+
+    for (int k = 0; k < track->keys.Count(); k++) {
+      const NoteKey *cKey = track->keys[k];
+      const std::string note = std::to_string(TSTRING(cKey->note.data()));
+      const float time = TicksToSec(cKey->time);
+      const bool isEnd =
+          note.size() > endSuffix.size() &&
+          !note.compare(note.size() - endSuffix.size(), endSuffix.size(),
+                        endSuffix);
+
+      if (!isEnd) {
+        openClips[note] = time;
+        continue;
+      }
+
+      const std::string name = note.substr(0, note.size() - endSuffix.size());
+      auto found = openClips.find(name);
+
+      if (found == openClips.end()) {
+        continue;
+      }
+
+      auto foundMarker = markerIndex.find(name);
+
+      if (foundMarker == markerIndex.end()) {
+        markerIndex[name] = markers.size();
+        markers.push_back({name, found->second, time});
+      } else {
+        markers[foundMarker->second] = {name, found->second, time};
+      }
+
+      openClips.erase(found);
+    }
+  }
+}
@@ -0,0 +1,75 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#pragma once
+#include "HavokMax.h"
+#include "HavokScene.h"
+#include "HavokStats.h"
+#include <notetrck.h>
+#include <memory>
+#include <unordered_map>
+
+class MaxScene;
+
+class MaxSceneNode : public HavokSceneNode {
+public:
+  INode *node;
+  MaxScene &scene;
+
+  MaxSceneNode(INode *node_, MaxScene &scene_) : node(node_), scene(scene_) {}
+
+  std::string GetName() const override;
+  void SetName(const std::string &name) override;
+  HavokSceneNode *GetParent() override;
+  void AttachChild(HavokSceneNode *child) override;
+  bool IsSelected() const override { return node->Selected() != 0; }
+  bool GetUserProp(const std::string &key, std::string &value) const override;
+  void SetUserProp(const std::string &key, const std::string &value) override;
+  AffineTM GetWorldTM(float time) override;
+  void SetWorldTM(float time, const AffineTM &value) override;
+  void SetLocalKeys(const std::vector<float> &times,
+                    const std::vector<AffineTM> &values) override;
+};
+
+class MaxScene : public HavokScene {
+public:
+  // Optional, counts GetNodeTM calls
+  HavokStats *stats = nullptr;
+
+  MaxSceneNode *Wrap(INode *node);
+
+  HavokSceneNode *CreateBone() override;
+  void EnumNodes(std::vector<HavokSceneNode *> &nodes) override;
+  float GetFrameRate() const override;
+  void SetAnimRange(float start, float end) override;
+  // Clip ranges are written as note keys on scene root,
+  // existing marker of the same name is replaced
+  void AddClipMarker(const std::string &name, float start,
+                     float end) override;
+  // Pairs "name" and "name end" note keys of scene root, unique by name
+  void GetClipMarkers(std::vector<HavokClipMarker> &markers) override;
+
+private:
+  DefNoteTrack *noteTrack = nullptr;
+  std::unordered_map<INode *, std::unique_ptr<MaxSceneNode>> nodes;
+};
+
+TimeValue ToTicks(float time);
+AffineTM ToAffineTM(const Matrix3 &mat);
+Matrix3 ToMatrix3(const AffineTM &mat);
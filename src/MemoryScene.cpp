@@ -0,0 +1,194 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#include "MemoryScene.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+static const float ticksPerSecond = 4800.0f;
+
+int32 ToMemoryTicks(float time) {
+  return static_cast<int32>(std::lround(time * ticksPerSecond));
+}
+
+void MemorySceneNode::AttachChild(HavokSceneNode *child) {
+  MemorySceneNode *cChild = static_cast<MemorySceneNode *>(child);
+
+  if (cChild->parent) {
+    auto &siblings = cChild->parent->children;
+    siblings.erase(std::remove(siblings.begin(), siblings.end(), cChild),
+                   siblings.end());
+  }
+
+  cChild->parent = this;
+  children.push_back(cChild);
+}
+
+bool MemorySceneNode::GetUserProp(const std::string &key,
+                                  std::string &value) const {
+  auto found = userProps.find(key);
+
+  if (found == userProps.end()) {
+    return false;
+  }
+
+  value = found->second;
+  return true;
+}
+
+static Vector4A16 Lerp(const Vector4A16 &v0, const Vector4A16 &v1,
+                       float delta) {
+  return v0 + (v1 - v0) * delta;
+}
+
+// Same as linear controllers set by MaxScene: linear position and scale,
+// normalized linear rotation by shortest path
+static AffineTM Interpolate(const AffineTM &tm0, const AffineTM &tm1,
+                            float delta) {
+  const Vector4A16 rot0 = tm0.GetRotation();
+  Vector4A16 rot1 = tm1.GetRotation();
+  const float dot =
+      rot0.X * rot1.X + rot0.Y * rot1.Y + rot0.Z * rot1.Z + rot0.W * rot1.W;
+
+  if (dot < 0.0f) {
+    rot1 = rot1 * -1.0f;
+  }
+
+  Vector4A16 rotation = Lerp(rot0, rot1, delta);
+  const float len =
+      std::sqrt(rotation.X * rotation.X + rotation.Y * rotation.Y +
+                rotation.Z * rotation.Z + rotation.W * rotation.W);
+
+  if (len > 0.0f) {
+    rotation = rotation * (1.0f / len);
+  }
+
+  const Vector4A16 scale = Lerp(tm0.GetScale(), tm1.GetScale(), delta);
+  AffineTM retVal;
+  retVal.SetRotate(rotation);
+
+  // Scale is applied to axes, same as it's decomposed by GetScale
+  retVal.SetRow(0, retVal.GetRow(0) * scale.X);
+  retVal.SetRow(1, retVal.GetRow(1) * scale.Y);
+  retVal.SetRow(2, retVal.GetRow(2) * scale.Z);
+  retVal.SetTrans(Lerp(tm0.GetTrans(), tm1.GetTrans(), delta));
+
+  return retVal;
+}
+
+AffineTM MemorySceneNode::GetLocalTM(float time) const {
+  if (keys.empty()) {
+    return localTM;
+  }
+
+  const int32 ticks = ToMemoryTicks(time);
+  auto next = keys.upper_bound(ticks);
+
+  if (next == keys.begin()) {
+    return next->second;
+  }
+
+  auto prev = std::prev(next);
+
+  if (next == keys.end()) {
+    return prev->second;
+  }
+
+  // Times rounding onto a key return it exactly
+  if (prev->first == ticks) {
+    return prev->second;
+  }
+
+  const float delta = (time * ticksPerSecond - prev->first) /
+                      static_cast<float>(next->first - prev->first);
+
+  return Interpolate(prev->second, next->second,
+                     std::min(std::max(delta, 0.0f), 1.0f));
+}
+
+AffineTM MemorySceneNode::GetWorldTM(float time) {
+  if (!parent) {
+    return GetLocalTM(time);
+  }
+
+  return GetLocalTM(time) * parent->GetWorldTM(time);
+}
+
+void MemorySceneNode::SetWorldTM(float time, const AffineTM &value) {
+  AffineTM cValue = parent ? value * parent->GetWorldTM(time).Inverse() : value;
+
+  if (keys.empty()) {
+    localTM = cValue;
+  } else {
+    keys[ToMemoryTicks(time)] = cValue;
+  }
+}
+
+void MemorySceneNode::SetLocalKeys(const std::vector<float> &times,
+                                   const std::vector<AffineTM> &values) {
+  keys.clear();
+
+  for (size_t k = 0; k < times.size(); k++) {
+    keys[ToMemoryTicks(times[k])] = values[k];
+  }
+}
+
+MemorySceneNode *MemoryScene::AddNode(const std::string &name,
+                                      MemorySceneNode *parent) {
+  nodes.emplace_back(new MemorySceneNode);
+  MemorySceneNode *node = nodes.back().get();
+  node->name = name;
+
+  if (parent) {
+    parent->AttachChild(node);
+  }
+
+  return node;
+}
+
+static void EnumChildren(MemorySceneNode *node,
+                         std::vector<HavokSceneNode *> &outNodes) {
+  outNodes.push_back(node);
+
+  for (auto c : node->children) {
+    EnumChildren(c, outNodes);
+  }
+}
+
+void MemoryScene::AddClipMarker(const std::string &name, float start,
+                                float end) {
+  auto found = std::find_if(
+      clipMarkers.begin(), clipMarkers.end(),
+      [&](const HavokClipMarker &m) { return m.name == name; });
+
+  if (found == clipMarkers.end()) {
+    clipMarkers.push_back({name, start, end});
+  } else {
+    *found = {name, start, end};
+  }
+}
+
+void MemoryScene::EnumNodes(std::vector<HavokSceneNode *> &outNodes) {
+  for (auto &n : nodes) {
+    if (!n->parent) {
+      EnumChildren(n.get(), outNodes);
+    }
+  }
+}
@@ -0,0 +1,81 @@
+/*  Havok Tool for 3ds Max
+    Copyright(C) 2019-2020 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+
+    Havok Tool uses HavokLib 2016-2020 Lukas Cone
+*/
+
+#pragma once
+#include "HavokScene.h"
+#include <map>
+#include <memory>
+
+// In-memory scene stand-in for running conversions without 3ds max.
+// Animation keys are interpolated like linear controllers set by MaxScene.
+// Times are rounded to ticks like in 3ds max, so slightly different float
+// expressions of the same frame always address the same key.
+int32 ToMemoryTicks(float time);
+
+class MemorySceneNode : public HavokSceneNode {
+public:
+  std::string name;
+  MemorySceneNode *parent = nullptr;
+  std::vector<MemorySceneNode *> children;
+  std::map<std::string, std::string> userProps;
+  // Keyed by ticks
+  std::map<int32, AffineTM> keys;
+  AffineTM localTM;
+  bool selected = false;
+
+  std::string GetName() const override { return name; }
+  void SetName(const std::string &newName) override { name = newName; }
+  HavokSceneNode *GetParent() override { return parent; }
+  void AttachChild(HavokSceneNode *child) override;
+  bool IsSelected() const override { return selected; }
+  bool GetUserProp(const std::string &key, std::string &value) const override;
+  void SetUserProp(const std::string &key, const std::string &value) override {
+    userProps[key] = value;
+  }
+  AffineTM GetLocalTM(float time) const;
+  AffineTM GetWorldTM(float time) override;
+  void SetWorldTM(float time, const AffineTM &value) override;
+  void SetLocalKeys(const std::vector<float> &times,
+                    const std::vector<AffineTM> &values) override;
+};
+
+class MemoryScene : public HavokScene {
+public:
+  std::vector<std::unique_ptr<MemorySceneNode>> nodes;
+  std::vector<HavokClipMarker> clipMarkers;
+  float frameRate = 30.0f;
+  float animStart = 0.0f;
+  float animEnd = 0.0f;
+
+  MemorySceneNode *AddNode(const std::string &name,
+                           MemorySceneNode *parent = nullptr);
+
+  HavokSceneNode *CreateBone() override { return AddNode(""); }
+  void EnumNodes(std::vector<HavokSceneNode *> &outNodes) override;
+  float GetFrameRate() const override { return frameRate; }
+  void SetAnimRange(float start, float end) override {
+    animStart = start;
+    animEnd = end;
+  }
+  void AddClipMarker(const std::string &name, float start,
+                     float end) override;
+  void GetClipMarkers(std::vector<HavokClipMarker> &markers) override {
+    markers = clipMarkers;
+  }
+};
@@ -58,6 +58,12 @@
 #define IDC_CH_DISABLE_SCALE            1041
 #define IDC_CHECK2                      1042
 #define IDC_CB_ADDITIVE_OVERRIDE        1043
+#define IDC_CH_ALL_MOTIONS              1044
+#define IDC_EDIT_MOTIONLIST             1045
+#define IDC_CH_ANICOMPRESS              1046
+#define IDC_CH_EXPORT_CLIPS             1047
+#define IDC_EDIT_CLIPLIST               1048
+#define IDC_CH_SEPARATE_CLIPS           1049
 #define IDC_COLOR                       1456
 #define IDC_EDIT                        1490
 #define IDC_EDIT_SCALE                  1490
@@ -78,7 +84,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        113
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1044
+#define _APS_NEXT_CONTROL_VALUE         1050
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif